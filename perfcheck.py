@@ -0,0 +1,166 @@
+import subprocess
+import os
+import sys
+import json
+import time
+import shutil
+import tempfile
+import statistics
+
+# Replays a local corpus through every input/output mode combination and compares
+# median wall time, peak memory and output size against a stored baseline.
+# Usage: perfcheck.py <swmeshexp> <corpus dir> <baseline file> [margin] [runs] [--update]
+
+if len(sys.argv) < 4:
+    print("Usage: perfcheck.py <swmeshexp> <corpus dir> <baseline file> [margin] [runs] [--update]")
+    exit(1)
+
+args = [a for a in sys.argv[1:] if a != "--update"]
+UPDATE = "--update" in sys.argv
+EXE = args[0]
+CORPUS_DIR = args[1]
+BASELINE = args[2]
+MARGIN = float(args[3]) if len(args) > 3 else 0.25  # Allowed slowdown/growth (0.25 = 25%)
+RUNS = int(args[4]) if len(args) > 4 else 5  # Runs per combination, the median is kept
+
+INPUT_MODES = {".mesh": "MESH", ".obj": "OBJ", ".ply": "PLY", ".swpack": "PACK", ".txt": "TEXT"}
+TEXT_HEADER = b"--BEGIN MESH OUTPUT--"
+OUTPUT_MODES = ["MESH", "OBJ", "PLY", "TEXT", "GLB", "SHM",
+                "MULTIMESH", "MULTIOBJ", "MULTIPLY", "DRYRUN"]
+OUTPUT_EXTS = {"MESH": ".mesh", "OBJ": ".obj", "PLY": ".ply", "TEXT": ".txt", "GLB": ".glb", "SHM": ".swmx",
+               "MULTIMESH": ".mesh", "MULTIOBJ": ".obj", "MULTIPLY": ".ply", "DRYRUN": ".none"}
+
+
+def corpus(d):
+    inputs = {}
+    for root, _, files in os.walk(d):
+        for file in sorted(files):
+            mode = INPUT_MODES.get(os.path.splitext(file)[1].lower())
+            if mode is None:
+                continue
+            path = os.path.join(root, file)
+            if mode == "TEXT" and not istextmesh(path):
+                continue  # Other text files (notes, logs...) are not meshes
+            if mode == "PACK":
+                # Every entry of a pack is an input of its own
+                inputs.setdefault(mode, []).extend(path + ":" + e for e in packentries(path))
+            else:
+                inputs.setdefault(mode, []).append(path)
+    return inputs
+
+
+def istextmesh(path):
+    with open(path, "rb") as f:
+        return f.read(len(TEXT_HEADER)) == TEXT_HEADER
+
+
+def packentries(pack):
+    listing = subprocess.run([EXE, "-l", pack], stdout=subprocess.PIPE).stdout.decode("utf-8")
+    return [line.split('"')[1] for line in listing.splitlines() if line.startswith('"')]
+
+
+def peak_memory(proc):
+    # Returns (exit code, peak memory in KB) once `proc` has exited
+    if os.name == "nt":
+        import ctypes
+        from ctypes import wintypes
+
+        class PROCESS_MEMORY_COUNTERS(ctypes.Structure):
+            _fields_ = [("cb", wintypes.DWORD), ("PageFaultCount", wintypes.DWORD),
+                        ("PeakWorkingSetSize", ctypes.c_size_t), ("WorkingSetSize", ctypes.c_size_t),
+                        ("QuotaPeakPagedPoolUsage", ctypes.c_size_t), ("QuotaPagedPoolUsage", ctypes.c_size_t),
+                        ("QuotaPeakNonPagedPoolUsage", ctypes.c_size_t), ("QuotaNonPagedPoolUsage", ctypes.c_size_t),
+                        ("PagefileUsage", ctypes.c_size_t), ("PeakPagefileUsage", ctypes.c_size_t)]
+
+        proc.wait()
+        counters = PROCESS_MEMORY_COUNTERS()
+        counters.cb = ctypes.sizeof(counters)
+        ctypes.windll.psapi.GetProcessMemoryInfo(int(proc._handle), ctypes.byref(counters), counters.cb)
+        return proc.returncode, counters.PeakWorkingSetSize // 1024
+
+    _, status, usage = os.wait4(proc.pid, 0)
+    proc.returncode = os.waitstatus_to_exitcode(status)
+    # ru_maxrss is in KB on Linux and in bytes on macOS
+    return proc.returncode, usage.ru_maxrss // (1024 if sys.platform == "darwin" else 1)
+
+
+def dirsize(d):
+    return sum(os.path.getsize(os.path.join(root, f)) for root, _, files in os.walk(d) for f in files)
+
+
+def replay(input_mode, output_mode, files):
+    # Converts every file once per run, the run's time is the sum over all files
+    times, peak, size = [], 0, 0
+    for _ in range(RUNS):
+        outdir = tempfile.mkdtemp(prefix="perfcheck")
+        elapsed = 0.0
+        for i, file in enumerate(files):
+            cmd = [EXE, "-I", input_mode, file, "-O", output_mode,
+                   "-o", os.path.join(outdir, str(i) + OUTPUT_EXTS[output_mode])]
+            start = time.perf_counter()
+            proc = subprocess.Popen(cmd, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+            code, kb = peak_memory(proc)
+            elapsed += time.perf_counter() - start
+            if code != 0:
+                shutil.rmtree(outdir, ignore_errors=True)
+                return None, f"exit code {code} converting \"{file}\""
+            peak = max(peak, kb)
+        times.append(elapsed * 1000.0)
+        size = dirsize(outdir)
+        shutil.rmtree(outdir, ignore_errors=True)
+
+    return {"time_ms": round(statistics.median(times), 3), "peak_rss_kb": peak, "output_bytes": size}, None
+
+
+inputs = corpus(CORPUS_DIR)
+if not inputs:
+    print(f"Error, no convertible files found in \"{CORPUS_DIR}\"")
+    exit(1)
+
+baseline = {}
+if os.path.isfile(BASELINE) and not UPDATE:
+    with open(BASELINE) as f:
+        baseline = json.load(f)
+
+results = {}
+failures = []
+added = []
+for input_mode, files in sorted(inputs.items()):
+    for output_mode in OUTPUT_MODES:
+        combination = f"{input_mode}->{output_mode}"
+        result, error = replay(input_mode, output_mode, files)
+        if error is not None:
+            print(f"{combination:<20} FAILED ({error})")
+            failures.append(combination)
+            continue
+
+        results[combination] = result
+        line = f"{combination:<20} {result['time_ms']:>10.1f} ms {result['peak_rss_kb']:>8} KB {result['output_bytes']:>12} B"
+
+        base = baseline.get(combination)
+        if base is not None:
+            over = [k for k in ("time_ms", "peak_rss_kb", "output_bytes") if result[k] > base[k] * (1.0 + MARGIN)]
+            if over:
+                line += "  REGRESSED: " + ", ".join(f"{k} {base[k]} -> {result[k]}" for k in over)
+                failures.append(combination)
+        elif baseline:
+            line += "  NEW (not in the baseline, added)"
+            added.append(combination)
+        print(line)
+
+# Successful combinations the baseline doesn't have yet are recorded (failed ones are left out, so they are
+# compared once they work), existing entries are only replaced with --update
+if not baseline and results:
+    with open(BASELINE, "w") as f:
+        json.dump(results, f, indent=2, sort_keys=True)
+    print(f"Baseline written to \"{BASELINE}\" ({len(results)} combinations, {sum(len(f) for f in inputs.values())} inputs)")
+elif added:
+    baseline.update({c: results[c] for c in added})
+    with open(BASELINE, "w") as f:
+        json.dump(baseline, f, indent=2, sort_keys=True)
+    print(f"Warning, {len(added)} combination(s) were not in the baseline and have been added to \"{BASELINE}\"")
+
+if failures:
+    print(f"{len(failures)} combination(s) failed or regressed beyond {MARGIN * 100:.0f}%")
+    exit(1)
+print(f"All {len(results)} combinations within {MARGIN * 100:.0f}% of the baseline")
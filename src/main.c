@@ -11,6 +11,12 @@
 #include <time.h>
 #include <stdbool.h>
 #include <memory.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <limits.h>
+#include <dirent.h>
+#include <malloc.h>
+#include <emmintrin.h>
 
 #define TINYOBJ_LOADER_C_IMPLEMENTATION
 #include "tinyobjloader-c/tinyobj_loader_c.h"
@@ -22,16 +28,31 @@
 const char* HELPSTR = "StormworksMeshExporter v" VERSION_STR " made by Nifley <https://github.com/NifleySnifley>\n"
 "Usage:\t swmeshexp.exe [options] <input> [-o output] ...\n"
 "\nOptions:\n"
-"\t-I <MODE>\tselects the input file format, <MODE> can be OBJ, MESH (stormworks), or PLY\n"
-"\t-O <MODE>\tselects the output file format, <MODE> can be OBJ, MESH (stormworks), \n\t\t\tPLY, TEXT (human-readable), or MULTIPLY (directory output with one PLY file per submesh)"
+"\t-I <MODE>\tselects the input file format, <MODE> can be OBJ, MESH (stormworks), PLY, PACK \n\t\t\t(mesh pack entries, given as <pack>.swpack:<entry>), or TEXT (as written by -O TEXT)\n"
+"\t-O <MODE>\tselects the output file format, <MODE> can be OBJ, MESH (stormworks), \n\t\t\tPLY, GLB (binary glTF), TEXT (human-readable), SHM (binary interop layout), or MULTIPLY, MULTIOBJ, MULTIMESH \n\t\t\t(directory output with one file per submesh, containing only the vertices it uses, \n\t\t\tnamed <id>-<shader>, with the submesh index appended when a name repeats)\n"
+"\t\t\tseveral comma-separated modes (e.g. PLY,OBJ,MESH) export each input to all of them in parallel\n"
+"\t-o <FILE>\tsets the output file of the previous input, with several output modes a comma-separated \n\t\t\tlist of files can be given (missing ones are named after the first file)\n"
+"\t-D, --dedupe <DIR>\n\t\t\tscans <DIR> recursively for files of the input format and reports groups of meshes and \n\t\t\tsubmeshes with identical geometry (regardless of IDs and triangle/vertex order)\n"
+"\t-L, --dedupe-link <DIR>\n\t\t\tlike -D, but also converts every unique mesh once (to the output format(s)) \n\t\t\tand hard-links (or copies) the result for its duplicates holding exactly the same data \n\t\t\t(duplicates differing in IDs or order are converted)\n"
+"\t-K, --pack <DIR>\n\t\t\tpacks every file of the input format in <DIR> (recursively) into the mesh pack <DIR>.swpack, \n\t\t\tentries are named by their relative path without extension\n"
+"\t-l, --list <PACK>\n\t\t\tlists the entries of a mesh pack\n"
+"\t-W, --watch <DIR>\n\t\t\twatches <DIR> (recursively) and converts each file of the input format whenever it is \n\t\t\tcreated or modified (to MESH unless -O is given), until stopped with Ctrl+C\n"
+"\t-d, --diff\tcompares the inputs in pairs (after processing) instead of converting them and reports \n\t\t\tper-submesh differences in positions, normals, colors, faces, shaders and bounds, \n\t\t\tvertices are matched by position regardless of order, exits with 9 if any pair differs\n"
+"\t-t, --tolerance <EPS>\n\t\t\tposition, normal and bounds tolerance for --diff (default 0.0001)\n"
+"\t-N, --normals <ANGLE>\n\t\t\tregenerates the normals of the previous input, smoothing faces that meet at less than \n\t\t\t<ANGLE> degrees (0 to 180, 0 for flat shading); on import, inputs without normals get them \n\t\t\tgenerated (60 degrees) and missing or invalid ones are filled in from their faces\n"
+"\t-c, --clean\tcleans up the previous input: removes degenerate (zero-area), duplicate and invalid faces, \n\t\t\tmerges identical vertices and removes unused ones, then reports what was removed\n"
+"\t-Z, --stream <MB>\n\t\t\tconverts PLY and OBJ inputs larger than memory using about <MB> megabytes (at least 8, \n\t\t\tincluding the caches of vertex data read back from temporary files), \n\t\t\tinto MESH parts named <output>_0.mesh, <output>_1.mesh, ... each within the 65536 vertex limit \n\t\t\t(a single submesh per part, OBJ objects and materials are not kept)\n"
+"\t-p\t\tpipelined mode: importing, processing and exporting of consecutive input files overlap\n"
 "\t-h\t\tshows this help dialog\n"
-"\t-C\t\tredirects mesh output to STDOUT (useful for interop)\n"
+"\t-C\t\tredirects mesh output to STDOUT (useful for interop), status messages are written to STDERR instead\n\t\t\t(applies to the files converted after it is given)\n"
+"\t-s <idx|ID>\tselects a single submesh of the next input by index or ID, only that submesh \n\t\t\t(and the vertices it uses) is imported\n"
 "\t-S <idx> submesh shader override (sets the shader of all imported submeshes to <idx>)\n\n"
 "Limitations & technical information:\n"
 "\tPLY import: due to the PLY format's limitations, only one submesh \n\t(encompassing all triangles/vertices) is created and the shader is set by default to opaque\n\n"
 "\tOBJ import: due to the OBJ format's lack of formal support for vertex colors \n\t(and tinyOBJ's lack of support for extended RGB vertex attributes), all vertices in each submesh \n\tare colored based on the name of the submesh if it matches a specific format \n\tsee https://github.com/Lewinator56/swMesh2XML_repo/blob/master/swMesh2XML\%20User\%20Guide.pdf \n\tfor more information\n\n"
 "\tOBJ export: shader types are appended to submesh IDs in parentheses, \n\tvertex colors are exported using informal XYZRGBA vertex attributes\n\tsee http://paulbourke.net/dataformats/obj/colour.html for more info\n\n"
 "\tPLY export: all submeshes are merged into one and shader types are not preserved.\n\n"
+"\tGLB export: each submesh is exported as a glTF primitive, its shader type is mapped to \n\ta material (glass is alpha-blended, emissive has an emissive factor) and its ID is stored in the primitive's extras\n\n"
 "Human-readable mesh format:\n"
 "\tthis tool also supports mesh output in a human-readable format using the `-O TEXT` flag\n"
 "\tthis feature is designed for debugging, easy extensibility, and integration into other applications\n"
@@ -40,16 +61,30 @@ const char* HELPSTR = "StormworksMeshExporter v" VERSION_STR " made by Nifley <h
 "\teach data element (vertex, face, submesh, etc.) is a simple comma-separated list of values\n"
 "\tcurrently the data types exported are: VERTICES, NORMALS, COLORS, TRIANGLES, SUBMESHES (in order)\n"
 "\tvertices and normals are X,Y,Z; colors are R,G,B,A; triangles are A,B,C (indices, starting at 0)\n"
-"\tsubmeshes are formatted as ID,start,count,<cullmin xyz>,<cullmax xyz>,shaderID\n";
-
-char tmp_buf[1024];
-
-const char* OUT_EXTS[6] = {
+"\tsubmeshes are formatted as ID,start,count,<cullmin xyz>,<cullmax xyz>,shaderID\n\n"
+"Binary interop layout:\n"
+"\t`-O SHM` writes a fixed little-endian layout that can be mapped and used without parsing (.swmx files)\n"
+"\twith `-C`, each mesh is placed in a named shared memory block instead and only \"<name> <size>\" is printed\n"
+"\tto STDOUT, the block is kept alive until a line (or EOF) is received on STDIN, after opening it\n"
+"\theader: \"SWMX\", version, vertex count, triangle count, submesh count, then the offsets of the\n"
+"\tvertices, triangles, submeshes and IDs and the total size (all uint32, offsets from the start of the block)\n"
+"\tvertices are 28 bytes (XYZ floats, RGBA bytes, normal XYZ floats), triangles are 3 uint16 indices\n"
+"\tsubmeshes are 40 bytes: start index, index count (uint32), shader, ID length (uint16), \n"
+"\tID offset (uint32), cullmin XYZ, cullmax XYZ (floats), each section is aligned to 16 bytes\n";
+
+// Mesh output redirected with -C goes here, status messages are moved to STDERR in that case
+FILE* cout_stream = NULL;
+
+const char* OUT_EXTS[10] = {
     ".ply",
     ".obj",
     ".ply",
     ".mesh",
     ".txt",
+    ".obj",
+    ".mesh",
+    ".glb",
+    ".swmx",
     ""
 };
 
@@ -59,22 +94,34 @@ enum OUTPUT_MODE {
     OUTPUT_MULTI_PLY,
     OUTPUT_STORMWORKS,
     OUTPUT_TEXT,
+    OUTPUT_MULTI_OBJ,
+    OUTPUT_MULTI_STORMWORKS,
+    OUTPUT_GLB,
+    OUTPUT_INTEROP,
     OUTPUT_NONE
 };
 
-const char* IN_EXTS[3] = {
+const char* IN_EXTS[5] = {
     ".mesh",
     ".obj",
-    ".ply"
+    ".ply",
+    ".swpack",
+    ".txt"
 };
 
 enum INPUT_MODE {
     INPUT_MESH,
     INPUT_OBJ,
     INPUT_PLY,
+    INPUT_PACK,
+    INPUT_TEXT,
 };
 
 const char* SIGNATURE = "mesh";
+const char* INTEROP_SIGNATURE = "SWMX";
+const char* PACK_SIGNATURE = "SWPK";
+// Pack entries are given as "<pack>.swpack:<entry name>"
+#define PACK_ENTRY_SEP ".swpack:"
 const char* SHADER_TYPES[4] = {
     "opaque",
     "glass",
@@ -134,22 +181,26 @@ typedef struct mesh {
     triangle* triangles;
     int n_submeshes;
     submesh* submeshes;
+    char* view; // Mapped file the vertices and triangles point into (NULL if they are allocated)
 } mesh;
 
-// Recalculates the bounding box of each submesh in `m` based on the vertices it contains
+// Recalculates the bounding box of each submesh in `m` based on the vertices referenced by its triangles
 void recalculate_submesh_bounds(mesh* m) {
     submesh* sm;
     for (int i = 0; i < m->n_submeshes; ++i) {
         sm = &m->submeshes[i];
-        sm->cullmin[0] = m->vertices[sm->start_index].x;
-        sm->cullmin[1] = m->vertices[sm->start_index].y;
-        sm->cullmin[2] = m->vertices[sm->start_index].z;
-        sm->cullmax[0] = m->vertices[sm->start_index].x;
-        sm->cullmax[1] = m->vertices[sm->start_index].y;
-        sm->cullmax[2] = m->vertices[sm->start_index].z;
+        if (sm->vertex_count == 0) continue;
+
+        int first = m->triangles[sm->start_index / 3].a;
+        sm->cullmin[0] = m->vertices[first].x;
+        sm->cullmin[1] = m->vertices[first].y;
+        sm->cullmin[2] = m->vertices[first].z;
+        sm->cullmax[0] = m->vertices[first].x;
+        sm->cullmax[1] = m->vertices[first].y;
+        sm->cullmax[2] = m->vertices[first].z;
 
         for (int j = 0; j < sm->vertex_count; ++j) {
-            int o = sm->start_index + j;
+            int o = m->triangles[(sm->start_index + j) / 3].i[(sm->start_index + j) % 3];
             sm->cullmax[0] = max(m->vertices[o].x, sm->cullmax[0]);
             sm->cullmax[1] = max(m->vertices[o].y, sm->cullmax[1]);
             sm->cullmax[2] = max(m->vertices[o].z, sm->cullmax[2]);
@@ -161,16 +212,32 @@ void recalculate_submesh_bounds(mesh* m) {
     }
 }
 
+void unmapfile(char* view);
+
 void freemesh(mesh* m) {
-    free(m->vertices);
+    if (m->view != NULL) {
+        unmapfile(m->view);
+        m->view = NULL;
+    } else {
+        free(m->vertices);
+        free(m->triangles);
+    }
     m->vertices = NULL;
-    free(m->triangles);
     m->triangles = NULL;
     for (int i = 0; i < m->n_submeshes; ++i) freesubmesh(&m->submeshes[i]);
     free(m->submeshes);
     m->submeshes = NULL;
 }
 
+// Makes `m` own its vertices and triangles if they are used in place from a mapping (which is released)
+void ownmesh(mesh* m) {
+    if (m->view == NULL) return;
+    m->vertices = memcpy(malloc(max(m->n_vertices, 1) * sizeof(vertex)), m->vertices, m->n_vertices * sizeof(vertex));
+    m->triangles = memcpy(malloc(max(m->n_triangles, 1) * sizeof(triangle)), m->triangles, m->n_triangles * sizeof(triangle));
+    unmapfile(m->view);
+    m->view = NULL;
+}
+
 // Appends the entire contents of the second mesh to the other.
 // (All vertices, faces, and submeshes of `src` are added to an enlargened `dest`)
 // The second mesh is neither modified not deallocated.
@@ -203,8 +270,96 @@ void concat_meshes(mesh* dest, mesh src) {
     dest->n_vertices += src.n_vertices;
 }
 
-void chgfname(char* name, int modeout) {
-    memcpy(strrchr(name, '.'), OUT_EXTS[modeout], strlen(OUT_EXTS[modeout]) + 1);
+// Selects a single submesh, either by its position in the submesh table or by its ID
+typedef struct submesh_selector {
+    int index; // -1 when selecting by ID
+    char* id;
+} submesh_selector;
+
+// Parses a selector argument, all-digit arguments select by index and anything else selects by ID
+submesh_selector parse_selector(char* argument) {
+    submesh_selector sel = { .index = -1, .id = argument };
+    if (strlen(argument) > 0 && strspn(argument, "0123456789") == strlen(argument)) {
+        sel.index = atoi(argument);
+        sel.id = NULL;
+    }
+    return sel;
+}
+
+bool selector_matches(submesh_selector sel, int index, char* id) {
+    if (sel.index >= 0) return sel.index == index;
+    return !strcmp(sel.id, id);
+}
+
+// Builds a standalone single-submesh mesh in `out` from `n_tris` triangles, keeping only the vertices they reference.
+// `verts` holds the vertices with indices starting at `vbase` (only the span referenced by `tris` needs to be present).
+// Vertices are renumbered in order of first reference, `sm` is copied (with a newly-allocated ID) and its bounds recalculated.
+void compact_triangles(vertex* verts, int vbase, int vspan, triangle* tris, int n_tris, submesh sm, mesh* out) {
+    int* remap = malloc(max(vspan, 1) * sizeof(int));
+    memset(remap, 0xFF, max(vspan, 1) * sizeof(int));
+
+    out->view = NULL;
+    out->n_vertices = 0;
+    out->vertices = malloc(max(min(vspan, n_tris * 3), 1) * sizeof(vertex));
+    out->n_triangles = n_tris;
+    out->triangles = malloc(max(n_tris, 1) * sizeof(triangle));
+
+    for (int t = 0; t < n_tris; ++t) {
+        for (int c = 0; c < 3; ++c) {
+            int local = tris[t].i[c] - vbase;
+            if (remap[local] < 0) {
+                remap[local] = out->n_vertices;
+                out->vertices[out->n_vertices++] = verts[local];
+            }
+            out->triangles[t].i[c] = remap[local];
+        }
+    }
+    free(remap);
+
+    out->n_submeshes = 1;
+    out->submeshes = malloc(sizeof(submesh));
+    out->submeshes[0] = copysubmesh(sm);
+    out->submeshes[0].start_index = 0;
+    out->submeshes[0].vertex_count = n_tris * 3;
+    recalculate_submesh_bounds(out);
+}
+
+// Copies submesh #`s` of `m` into `out` as a standalone mesh containing only its own triangles and vertices
+void extract_submesh(mesh m, int s, mesh* out) {
+    submesh sm = m.submeshes[s];
+    triangle* tris = &m.triangles[sm.start_index / 3];
+    int n_tris = sm.vertex_count / 3;
+
+    // Only the span of vertices actually referenced needs a remapping table
+    int vmin = m.n_vertices, vmax = -1;
+    for (int t = 0; t < n_tris; ++t) {
+        for (int c = 0; c < 3; ++c) {
+            vmin = min(vmin, tris[t].i[c]);
+            vmax = max(vmax, tris[t].i[c]);
+        }
+    }
+    if (vmax < 0) vmin = vmax = 0;
+
+    compact_triangles(&m.vertices[vmin], vmin, vmax - vmin + 1, tris, n_tris, sm, out);
+}
+
+// Returns a newly-allocated copy of `name` with its extension replaced by the one of output mode `modeout`
+char* chgfname(char* name, int modeout) {
+    // Pack entries are named after the last component of the entry name
+    char* entry = strstr(name, PACK_ENTRY_SEP);
+    if (entry != NULL) {
+        name = entry + strlen(PACK_ENTRY_SEP);
+        if (strrchr(name, '/') != NULL) name = strrchr(name, '/') + 1;
+    }
+
+    char* newname = malloc(strlen(name) + strlen(OUT_EXTS[modeout]) + 1);
+    strcpy(newname, name);
+
+    char* ext = strrchr(newname, '.');
+    if (ext == NULL || strpbrk(ext, "/\\") != NULL) ext = &newname[strlen(newname)];
+    strcpy(ext, OUT_EXTS[modeout]);
+
+    return newname;
 }
 
 int replacechar(char* str, char orig, char rep) {
@@ -217,21 +372,101 @@ int replacechar(char* str, char orig, char rep) {
     return n;
 }
 
+// Work function for `parallel_for`, called once for every index in [0, n)
+typedef void (*parallel_fn)(void* ctx, int i);
+
+typedef struct parallel_job {
+    parallel_fn fn;
+    void* ctx;
+    int n;
+    volatile LONG next;
+} parallel_job;
+
+DWORD WINAPI parallel_worker(LPVOID param) {
+    parallel_job* job = param;
+    int i;
+    while ((i = InterlockedIncrement(&job->next) - 1) < job->n) job->fn(job->ctx, i);
+    return 0;
+}
+
+int cpu_count() {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return max((int)info.dwNumberOfProcessors, 1);
+}
+
+// Calls `fn(ctx, i)` for every i in [0, n) using up to one thread per CPU (the calling thread included)
+// Indices are handed out dynamically, so uneven work items are balanced between the threads
+void parallel_for(int n, parallel_fn fn, void* ctx) {
+    parallel_job job = { .fn = fn, .ctx = ctx, .n = n, .next = 0 };
+    HANDLE threads[MAXIMUM_WAIT_OBJECTS];
+    int nthreads = min(min(n, cpu_count()), MAXIMUM_WAIT_OBJECTS) - 1;
+
+    int started = 0;
+    for (; started < nthreads; ++started) {
+        threads[started] = CreateThread(NULL, 0, parallel_worker, &job, 0, NULL);
+        if (threads[started] == NULL) break;
+    }
+
+    parallel_worker(&job);
+
+    if (started > 0) WaitForMultipleObjects(started, threads, TRUE, INFINITE);
+    for (int t = 0; t < started; ++t) CloseHandle(threads[t]);
+}
+
+// Wall-clock time in milliseconds (from an arbitrary starting point)
+double now_ms() {
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (double)counter.QuadPart * 1000.0 / (double)frequency.QuadPart;
+}
+
 char* readbytes(char* filename, size_t* len) {
     struct stat st;
-    stat(filename, &st);
+    if (stat(filename, &st)) return NULL;
     *len = st.st_size;
 
     char* buf = malloc(*len * sizeof(char));
 
     FILE* fhandle = fopen(filename, "rb");
-    if (fhandle == NULL) return NULL;
+    if (fhandle == NULL) {
+        free(buf);
+        return NULL;
+    }
     fread(buf, *len, 1, fhandle);
     fclose(fhandle);
 
     return buf;
 }
 
+// Maps the whole file `filename` into memory, returns NULL if it can't be mapped (e.g. it is empty)
+// With `copy_on_write`, the view can be modified without affecting the file
+char* mapfile(char* filename, size_t* len, bool copy_on_write) {
+    HANDLE file = CreateFile(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return NULL;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return NULL;
+    }
+    *len = size.QuadPart;
+
+    HANDLE mapping = CreateFileMapping(file, NULL, copy_on_write ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL) return NULL;
+
+    // The view keeps the mapping alive until it is unmapped
+    char* view = MapViewOfFile(mapping, copy_on_write ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    return view;
+}
+
+void unmapfile(char* view) {
+    UnmapViewOfFile(view);
+}
+
 void tinyOBJ_loadFile(void* ctx, const char* filename, const int is_mtl, const char* obj_filename, char** buffer, size_t* len) {
     *buffer = readbytes((char*)filename, len);
 }
@@ -272,7 +507,7 @@ exit:
 }
 
 mesh readobj(char* filename, int* err) {
-    mesh m;
+    mesh m = { 0 };
     m.n_submeshes = 0;
     m.n_vertices = 0;
     m.n_triangles = 0;
@@ -308,13 +543,15 @@ mesh readobj(char* filename, int* err) {
     for (int t = 0; t < m.n_triangles; ++t) {
         for (int v = 0; v < 3; ++v) {
             tinyobj_vertex_index_t face_vert = obj_attrs.faces[t * 3 + v];
+            // Faces without normals are left with zero normals, which are generated later
+            bool hasnormal = face_vert.vn_idx >= 0 && (unsigned)face_vert.vn_idx < obj_attrs.num_normals;
             m.vertices[t * 3 + v] = (vertex){
                 .x = obj_attrs.vertices[face_vert.v_idx * 3],
                 .y = obj_attrs.vertices[face_vert.v_idx * 3 + 1],
                 .z = obj_attrs.vertices[face_vert.v_idx * 3 + 2],
-                .nx = obj_attrs.normals[face_vert.vn_idx * 3],
-                .ny = obj_attrs.normals[face_vert.vn_idx * 3 + 1],
-                .nz = obj_attrs.normals[face_vert.vn_idx * 3 + 2],
+                .nx = hasnormal ? obj_attrs.normals[face_vert.vn_idx * 3] : 0,
+                .ny = hasnormal ? obj_attrs.normals[face_vert.vn_idx * 3 + 1] : 0,
+                .nz = hasnormal ? obj_attrs.normals[face_vert.vn_idx * 3 + 2] : 0,
                 .r = 0,
                 .g = 0,
                 .b = 0,
@@ -482,7 +719,7 @@ static int plyreader_face_cb(p_ply_argument argument) {
 }
 
 mesh readply(char* filename, int* err) {
-    mesh m;
+    mesh m = { 0 };
     long nvertices, ntriangles;
 
     p_ply ply = ply_open(filename, NULL, 0, NULL);
@@ -510,7 +747,8 @@ mesh readply(char* filename, int* err) {
     // Allocate space in the mesh
     m.n_vertices = (int)nvertices;
     m.n_triangles = (int)ntriangles;
-    m.vertices = malloc(m.n_vertices * sizeof(vertex));
+    // Properties missing from the file (e.g. normals) are left zeroed
+    m.vertices = calloc(m.n_vertices, sizeof(vertex));
     m.triangles = malloc(m.n_triangles * sizeof(triangle));
 
     // Create a single submesh encompassing the entire mesh
@@ -520,7 +758,9 @@ mesh readply(char* filename, int* err) {
     sm.shadertype = 0;
     sm.start_index = 0;
     sm.vertex_count = m.n_triangles * 3;
-    sm.id = basename(filename);
+    char* name = basename(filename);
+    sm.id = malloc(strlen(name) + 1);
+    strcpy(sm.id, name);
     m.submeshes[0] = sm;
 
     // Read all of the data from the file (using the registered callbacks)
@@ -556,8 +796,6 @@ int writeply(mesh m, FILE* destfd) {
         );
     }
 
-    fclose(ply);
-
     return 0;
 }
 
@@ -606,9 +844,678 @@ int writedebug(mesh m, FILE* destfd) {
     return 0;
 }
 
+// Cursor over a mapped TEXT file, numbers are parsed in place without copying or allocating
+typedef struct textcursor {
+    const char* p;
+    const char* end;
+} textcursor;
+
+// Skips whitespace and the commas separating values on a line
+void text_skip(textcursor* c) {
+    while (c->p < c->end && (*c->p == ' ' || *c->p == '\t' || *c->p == '\r' || *c->p == '\n' || *c->p == ',')) ++c->p;
+}
+
+bool text_int(textcursor* c, long* out) {
+    text_skip(c);
+    bool neg = c->p < c->end && *c->p == '-';
+    if (c->p < c->end && (*c->p == '-' || *c->p == '+')) ++c->p;
+
+    const char* start = c->p;
+    int64_t v = 0;
+    while (c->p < c->end && *c->p >= '0' && *c->p <= '9') {
+        v = v * 10 + (*c->p++ - '0');
+        if (v > LONG_MAX) return false; // `long` is 32 bits on Windows
+    }
+    if (c->p == start) return false;
+
+    *out = neg ? -v : v;
+    return true;
+}
+
+bool text_float(textcursor* c, float* out) {
+    static const double POW10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+    text_skip(c);
+    bool neg = c->p < c->end && *c->p == '-';
+    if (c->p < c->end && (*c->p == '-' || *c->p == '+')) ++c->p;
+
+    // printf writes non-finite values as "inf" and "nan" (or "-nan(ind)" etc.)
+    if (c->p + 3 <= c->end && (!strncasecmp(c->p, "inf", 3) || !strncasecmp(c->p, "nan", 3))) {
+        *out = ((*c->p | 0x20) == 'i') ? (neg ? -INFINITY : INFINITY) : NAN;
+        while (c->p < c->end && *c->p != ',' && *c->p != '\n' && *c->p != '\r' && *c->p != ' ') ++c->p;
+        return true;
+    }
+
+    // Up to 19 significant digits are accumulated exactly, the rest only shift the exponent
+    uint64_t mantissa = 0;
+    int digits = 0, exponent = 0;
+    const char* start = c->p;
+    for (; c->p < c->end && *c->p >= '0' && *c->p <= '9'; ++c->p) {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (*c->p - '0');
+            if (mantissa) ++digits;
+        } else {
+            ++exponent;
+        }
+    }
+    if (c->p < c->end && *c->p == '.') {
+        ++c->p;
+        for (; c->p < c->end && *c->p >= '0' && *c->p <= '9'; ++c->p) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*c->p - '0');
+                if (mantissa) ++digits;
+                --exponent;
+            }
+        }
+    }
+    if (c->p == start || (c->p == start + 1 && *start == '.')) return false;
+
+    if (c->p < c->end && (*c->p == 'e' || *c->p == 'E')) {
+        ++c->p;
+        long e;
+        if (!text_int(c, &e)) return false;
+        exponent += (int)max(min(e, 1000), -1000);
+    }
+
+    double v = (double)mantissa;
+    while (exponent > 22) { v *= 1e22; exponent -= 22; }
+    while (exponent < -22) { v /= 1e22; exponent += 22; }
+    v = exponent < 0 ? v / POW10[-exponent] : v * POW10[exponent];
+
+    *out = (float)(neg ? -v : v);
+    return true;
+}
+
+// Reads a section header such as "12 VERTICES", `name` is left pointing into the buffer
+bool text_section(textcursor* c, long* count, const char** name, size_t* namelen) {
+    if (!text_int(c, count) || *count < 0) return false;
+    text_skip(c);
+    *name = c->p;
+    while (c->p < c->end && *c->p >= 'A' && *c->p <= 'Z') ++c->p;
+    *namelen = c->p - *name;
+    return *namelen > 0;
+}
+
+// Every value takes at least a digit and a separator, so a count the rest of the file can't hold is rejected
+// before anything is allocated for it
+bool text_fits(textcursor* c, long count, int values) {
+    return (uint64_t)count * values * 2 <= (uint64_t)(c->end - c->p) + 1;
+}
+
+bool text_keyword(textcursor* c, const char* keyword) {
+    text_skip(c);
+    size_t len = strlen(keyword);
+    if ((size_t)(c->end - c->p) < len || memcmp(c->p, keyword, len)) return false;
+    c->p += len;
+    return true;
+}
+
+#define TEXT_SECTION_IS(NAME) (namelen == strlen(NAME) && !memcmp(name, NAME, namelen))
+
+// Reads a mesh written by `writedebug` (-O TEXT), parsing the mapped file in place
+// Missing NORMALS/COLORS are left zeroed, and without SUBMESHES a single one covers the whole mesh
+mesh readtext(char* filename, int* err) {
+    mesh m = { 0 };
+    size_t len = 0;
+    char* view = mapfile(filename, &len, false);
+    if (view == NULL) {
+        *err = 1;
+        return m;
+    }
+
+    textcursor c = { view, view + len };
+    if (!text_keyword(&c, "--BEGIN MESH OUTPUT--")) {
+        *err = 2;
+        goto exit;
+    }
+
+    while (!*err && !text_keyword(&c, "--END MESH OUTPUT--")) {
+        long count;
+        const char* name;
+        size_t namelen;
+        if (!text_section(&c, &count, &name, &namelen)) {
+            *err = 2;
+            break;
+        }
+
+        if (TEXT_SECTION_IS("VERTICES")) {
+            // The vertex count is stored in 16 bits in .mesh files
+            if (m.vertices != NULL || count > UINT16_MAX || !text_fits(&c, count, 3)) { *err = 5; break; }
+            m.vertices = calloc(max(count, 1), sizeof(vertex));
+            if (m.vertices == NULL) { *err = 5; break; }
+            m.n_vertices = (int)count;
+            for (long v = 0; v < count && !*err; ++v) {
+                for (int k = 0; k < 3; ++k) {
+                    if (!text_float(&c, &m.vertices[v].pos[k])) *err = 3;
+                }
+            }
+        } else if (TEXT_SECTION_IS("NORMALS")) {
+            if (count != m.n_vertices || !text_fits(&c, count, 3)) { *err = 5; break; }
+            for (long v = 0; v < count && !*err; ++v) {
+                for (int k = 0; k < 3; ++k) {
+                    if (!text_float(&c, &m.vertices[v].norm[k])) *err = 3;
+                }
+            }
+        } else if (TEXT_SECTION_IS("COLORS")) {
+            if (count != m.n_vertices || !text_fits(&c, count, 4)) { *err = 5; break; }
+            for (long v = 0; v < count && !*err; ++v) {
+                for (int k = 0; k < 4; ++k) {
+                    long value;
+                    if (!text_int(&c, &value)) *err = 3;
+                    else if (value < 0 || value > 255) *err = 5;
+                    else m.vertices[v].col[k] = (uint8_t)value;
+                }
+            }
+        } else if (TEXT_SECTION_IS("TRIANGLES")) {
+            if (m.triangles != NULL || count > INT32_MAX / 3 || !text_fits(&c, count, 3)) { *err = 5; break; }
+            m.triangles = malloc(max(count, 1) * sizeof(triangle));
+            if (m.triangles == NULL) { *err = 5; break; }
+            m.n_triangles = (int)count;
+            for (long t = 0; t < count && !*err; ++t) {
+                long i[3] = { 0 };
+                for (int k = 0; k < 3 && !*err; ++k) {
+                    if (!text_int(&c, &i[k])) *err = 3;
+                    else if (i[k] < 0 || i[k] >= m.n_vertices) *err = 5;
+                }
+                // writedebug lists the corners as b, a, c
+                m.triangles[t].b = (uint16_t)i[0];
+                m.triangles[t].a = (uint16_t)i[1];
+                m.triangles[t].c = (uint16_t)i[2];
+            }
+        } else if (TEXT_SECTION_IS("SUBMESHES")) {
+            if (m.submeshes != NULL || count > UINT16_MAX || !text_fits(&c, count, 10)) { *err = 5; break; }
+            m.submeshes = malloc(max(count, 1) * sizeof(submesh));
+            if (m.submeshes == NULL) { *err = 5; break; }
+            for (long s = 0; s < count && !*err; ++s) {
+                // "<id>", <first face>, <face count>, <cull min xyz>, <cull max xyz>, <shader>
+                text_skip(&c);
+                if (c.p >= c.end || *c.p != '"') { *err = 3; break; }
+                const char* id = ++c.p;
+                while (c.p < c.end && *c.p != '"' && *c.p != '\n') ++c.p;
+                if (c.p >= c.end || *c.p != '"') { *err = 3; break; }
+
+                submesh* sm = &m.submeshes[m.n_submeshes++];
+                sm->id = malloc(c.p - id + 1);
+                memcpy(sm->id, id, c.p - id);
+                sm->id[c.p - id] = '\0';
+                ++c.p;
+
+                long start, faces, shader;
+                if (!text_int(&c, &start) || !text_int(&c, &faces)) { *err = 3; break; }
+                for (int k = 0; k < 3; ++k) if (!text_float(&c, &sm->cullmin[k])) *err = 3;
+                for (int k = 0; k < 3; ++k) if (!text_float(&c, &sm->cullmax[k])) *err = 3;
+                if (!text_int(&c, &shader)) *err = 3;
+                if (!*err && (start < 0 || faces < 0 || start + faces > m.n_triangles || shader < 0 || shader > UINT16_MAX)) *err = 5;
+                sm->start_index = (int)start * 3;
+                sm->vertex_count = (int)faces * 3;
+                sm->shadertype = (int)shader;
+            }
+        } else {
+            *err = 2;
+        }
+    }
+
+    if (!*err && m.vertices == NULL) *err = 5;
+    if (!*err && m.submeshes == NULL) {
+        // Like OBJ and PLY files, a mesh without submeshes gets a single one encompassing it
+        m.n_submeshes = 1;
+        m.submeshes = malloc(sizeof(submesh));
+        char* base = basename(filename);
+        m.submeshes[0] = (submesh){ .start_index = 0, .vertex_count = m.n_triangles * 3, .shadertype = 0 };
+        m.submeshes[0].id = malloc(strlen(base) + 1);
+        strcpy(m.submeshes[0].id, base);
+        recalculate_submesh_bounds(&m);
+    }
+    if (!*err && m.triangles == NULL) m.triangles = malloc(sizeof(triangle));
+
+exit:
+    if (*err) {
+        if (*err == 3) printf("Error, malformed value at byte %lld of \"%s\"\n", (long long)(c.p - view), filename);
+        freemesh(&m);
+        m = (mesh){ 0 };
+    }
+    unmapfile(view);
+    return m;
+}
+
+// Growable string buffer for building text (e.g. JSON) in memory
+typedef struct strbuf {
+    char* data;
+    size_t len, cap;
+} strbuf;
+
+void strbuf_printf(strbuf* sb, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+
+    if (sb->len + n + 1 > sb->cap) {
+        sb->cap = max(sb->cap * 2, sb->len + n + 1);
+        sb->data = realloc(sb->data, sb->cap);
+    }
+
+    va_start(args, fmt);
+    vsnprintf(&sb->data[sb->len], n + 1, fmt, args);
+    va_end(args);
+    sb->len += n;
+}
+
+// Appends `str` as a quoted JSON string
+void strbuf_jsonstr(strbuf* sb, const char* str) {
+    strbuf_printf(sb, "\"");
+    for (const char* c = str; *c; ++c) {
+        if (*c == '"' || *c == '\\') strbuf_printf(sb, "\\%c", *c);
+        else if ((unsigned char)*c < 0x20) strbuf_printf(sb, "\\u%04x", *c);
+        else strbuf_printf(sb, "%c", *c);
+    }
+    strbuf_printf(sb, "\"");
+}
+
+// Writes `m` to `destfd` in binary glTF (.glb) format, with one primitive per submesh
+// The binary buffer is written straight from the mesh arrays: the interleaved vertex array is a single
+// strided buffer view (position, color and normal accessors), and every submesh's indices are an accessor
+// into the triangle array, so nothing is converted or copied
+int writeglb(mesh m, FILE* destfd) {
+    size_t vertbytes = m.n_vertices * sizeof(vertex);
+    size_t tribytes = m.n_triangles * sizeof(triangle);
+    size_t binlen = (vertbytes + tribytes + 3) & ~3;
+
+    // glTF has no empty buffers, accessors or meshes
+    int n_nonempty = 0;
+    for (int s = 0; s < m.n_submeshes; ++s) n_nonempty += m.submeshes[s].vertex_count > 0;
+    if (m.n_vertices == 0 || n_nonempty == 0) {
+        printf("Error, glTF files can't hold a mesh without faces\n");
+        return 5;
+    }
+
+    // POSITION accessors require bounds, which must be valid JSON numbers
+    float posmin[3] = { 0, 0, 0 }, posmax[3] = { 0, 0, 0 };
+    for (int v = 0; v < m.n_vertices; ++v) {
+        for (int a = 0; a < 3; ++a) {
+            if (!isfinite(m.vertices[v].pos[a])) {
+                printf("Error, vertex %d has a NaN or infinite position, which glTF can't hold\n", v);
+                return 6;
+            }
+            if (v == 0 || m.vertices[v].pos[a] < posmin[a]) posmin[a] = m.vertices[v].pos[a];
+            if (v == 0 || m.vertices[v].pos[a] > posmax[a]) posmax[a] = m.vertices[v].pos[a];
+        }
+    }
+
+    strbuf json = { 0 };
+    strbuf_printf(&json, "{\"asset\":{\"version\":\"2.0\",\"generator\":\"StormworksMeshExporter v" VERSION_STR "\"},");
+    strbuf_printf(&json, "\"scene\":0,\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"mesh\":0}],");
+
+    // One material per shader type (opaque, glass, emissive, unknown)
+    strbuf_printf(&json, "\"materials\":["
+        "{\"name\":\"opaque\",\"pbrMetallicRoughness\":{\"metallicFactor\":0,\"roughnessFactor\":1}},"
+        "{\"name\":\"glass\",\"alphaMode\":\"BLEND\",\"pbrMetallicRoughness\":{\"baseColorFactor\":[1,1,1,0.5],\"metallicFactor\":0,\"roughnessFactor\":0}},"
+        "{\"name\":\"emissive\",\"emissiveFactor\":[1,1,1],\"pbrMetallicRoughness\":{\"metallicFactor\":0,\"roughnessFactor\":1}},"
+        "{\"name\":\"unknown\",\"pbrMetallicRoughness\":{\"metallicFactor\":0,\"roughnessFactor\":1}}],");
+
+    strbuf_printf(&json, "\"meshes\":[{\"primitives\":[");
+    int n_primitives = 0;
+    for (int s = 0; s < m.n_submeshes; ++s) {
+        submesh sm = m.submeshes[s];
+        if (sm.vertex_count == 0) continue; // Empty accessors are not allowed
+
+        // Index accessors follow the 3 vertex attribute accessors
+        strbuf_printf(&json, "%s{\"attributes\":{\"POSITION\":0,\"COLOR_0\":1,\"NORMAL\":2},\"indices\":%d,\"material\":%d,\"mode\":4,\"extras\":{\"id\":",
+            n_primitives ? "," : "", 3 + n_primitives, min(sm.shadertype, 3));
+        strbuf_jsonstr(&json, sm.id);
+        strbuf_printf(&json, "}}");
+        n_primitives++;
+    }
+    strbuf_printf(&json, "]}],");
+
+    strbuf_printf(&json, "\"buffers\":[{\"byteLength\":%u}],", (unsigned)binlen);
+    strbuf_printf(&json, "\"bufferViews\":["
+        "{\"buffer\":0,\"byteOffset\":0,\"byteLength\":%u,\"byteStride\":%u,\"target\":34962},"
+        "{\"buffer\":0,\"byteOffset\":%u,\"byteLength\":%u,\"target\":34963}],",
+        (unsigned)vertbytes, (unsigned)sizeof(vertex), (unsigned)vertbytes, (unsigned)tribytes);
+
+    // Vertex attributes share the interleaved vertex buffer view
+    strbuf_printf(&json, "\"accessors\":["
+        "{\"bufferView\":0,\"byteOffset\":%u,\"componentType\":5126,\"count\":%d,\"type\":\"VEC3\",\"min\":[%g,%g,%g],\"max\":[%g,%g,%g]},"
+        "{\"bufferView\":0,\"byteOffset\":%u,\"componentType\":5121,\"normalized\":true,\"count\":%d,\"type\":\"VEC4\"},"
+        "{\"bufferView\":0,\"byteOffset\":%u,\"componentType\":5126,\"count\":%d,\"type\":\"VEC3\"}",
+        (unsigned)offsetof(vertex, pos), m.n_vertices, posmin[0], posmin[1], posmin[2], posmax[0], posmax[1], posmax[2],
+        (unsigned)offsetof(vertex, col), m.n_vertices,
+        (unsigned)offsetof(vertex, norm), m.n_vertices);
+
+    // Index accessors slice the triangle buffer view at each submesh's range
+    for (int s = 0; s < m.n_submeshes; ++s) {
+        submesh sm = m.submeshes[s];
+        if (sm.vertex_count == 0) continue;
+        strbuf_printf(&json, ",{\"bufferView\":1,\"byteOffset\":%u,\"componentType\":5123,\"count\":%d,\"type\":\"SCALAR\"}",
+            (unsigned)(sm.start_index * sizeof(uint16_t)), sm.vertex_count);
+    }
+    strbuf_printf(&json, "]}");
+
+    // The JSON chunk is padded with spaces, the binary chunk with zeros
+    while (json.len % 4) strbuf_printf(&json, " ");
+
+    uint32_t header[5] = {
+        0x46546C67, // "glTF"
+        2,
+        12 + 8 + json.len + 8 + binlen,
+        json.len,
+        0x4E4F534A // "JSON"
+    };
+    uint32_t binheader[2] = { binlen, 0x004E4942 }; // "BIN"
+
+    fwrite(header, sizeof(header), 1, destfd);
+    fwrite(json.data, 1, json.len, destfd);
+    fwrite(binheader, sizeof(binheader), 1, destfd);
+    fwrite(m.vertices, sizeof(vertex), m.n_vertices, destfd);
+    fwrite(m.triangles, sizeof(triangle), m.n_triangles, destfd);
+    fwrite("\0\0\0", 1, binlen - vertbytes - tribytes, destfd);
+
+    free(json.data);
+    fflush(destfd);
+
+    return 0;
+}
+
+// Fixed binary interop layout (little-endian, all offsets are from the start of the block)
+// Sections are 16-byte aligned: header, vertices, triangles, submesh table, submesh IDs
+// A consumer can map the block and use the vertex and triangle arrays in place
+typedef struct interop_header {
+    char magic[4]; // "SWMX"
+    uint32_t version; // 1
+    uint32_t n_vertices;
+    uint32_t n_triangles;
+    uint32_t n_submeshes;
+    uint32_t vertices_offset; // n_vertices vertices, 28b each (same layout as .mesh: XYZ, RGBA, normal XYZ)
+    uint32_t triangles_offset; // n_triangles triangles, 3 uint16 indices each
+    uint32_t submeshes_offset; // n_submeshes interop_submesh records
+    uint32_t strings_offset; // NUL-terminated submesh IDs
+    uint32_t total_size;
+} interop_header;
+
+typedef struct interop_submesh {
+    uint32_t start_index; // First index into the triangle array (triangle * 3)
+    uint32_t vertex_count; // Number of indices (triangles * 3)
+    uint16_t shadertype;
+    uint16_t id_length;
+    uint32_t id_offset;
+    float cullmin[3];
+    float cullmax[3];
+} interop_submesh;
+
+#define INTEROP_ALIGN(x) (((x) + 15) & ~(size_t)15)
+
+// Fills `h` with the section offsets of `m` in the interop layout
+void interoplayout(mesh m, interop_header* h) {
+    memcpy(h->magic, INTEROP_SIGNATURE, 4);
+    h->version = 1;
+    h->n_vertices = m.n_vertices;
+    h->n_triangles = m.n_triangles;
+    h->n_submeshes = m.n_submeshes;
+    h->vertices_offset = INTEROP_ALIGN(sizeof(interop_header));
+    h->triangles_offset = INTEROP_ALIGN(h->vertices_offset + m.n_vertices * sizeof(vertex));
+    h->submeshes_offset = INTEROP_ALIGN(h->triangles_offset + m.n_triangles * sizeof(triangle));
+    h->strings_offset = INTEROP_ALIGN(h->submeshes_offset + m.n_submeshes * sizeof(interop_submesh));
+
+    size_t strings = 0;
+    for (int s = 0; s < m.n_submeshes; ++s) strings += strlen(m.submeshes[s].id) + 1;
+    h->total_size = INTEROP_ALIGN(h->strings_offset + strings);
+}
+
+// Returns the exact size in bytes of `m` in the interop layout
+size_t interopsize(mesh m) {
+    interop_header h;
+    interoplayout(m, &h);
+    return h.total_size;
+}
+
+// Encodes `m` in the interop layout into `buf`, which must hold at least `interopsize(m)` bytes
+// Returns the number of bytes written
+size_t encodeinterop(mesh m, char* buf) {
+    interop_header h;
+    interoplayout(m, &h);
+    memset(buf, 0, h.total_size);
+
+    memcpy(buf, &h, sizeof(h));
+    memcpy(&buf[h.vertices_offset], m.vertices, m.n_vertices * sizeof(vertex));
+    memcpy(&buf[h.triangles_offset], m.triangles, m.n_triangles * sizeof(triangle));
+
+    size_t cursor = h.strings_offset;
+    for (int s = 0; s < m.n_submeshes; ++s) {
+        submesh sm = m.submeshes[s];
+        interop_submesh rec = {
+            .start_index = sm.start_index,
+            .vertex_count = sm.vertex_count,
+            .shadertype = sm.shadertype,
+            .id_length = strlen(sm.id),
+            .id_offset = cursor
+        };
+        memcpy(rec.cullmin, sm.cullmin, sizeof(rec.cullmin));
+        memcpy(rec.cullmax, sm.cullmax, sizeof(rec.cullmax));
+        memcpy(&buf[h.submeshes_offset + s * sizeof(interop_submesh)], &rec, sizeof(rec));
+
+        memcpy(&buf[cursor], sm.id, rec.id_length + 1);
+        cursor += rec.id_length + 1;
+    }
+
+    return h.total_size;
+}
+
+// Writes `m` to `destfd` in the interop layout
+int writeinterop(mesh m, FILE* destfd) {
+    size_t size = interopsize(m);
+    char* buf = malloc(size);
+    if (buf == NULL) return 3;
+
+    encodeinterop(m, buf);
+    size_t written = fwrite(buf, 1, size, destfd);
+    free(buf);
+
+    fflush(destfd);
+
+    return written == size ? 0 : 4;
+}
+
+// Places `m` in a named shared memory block in the interop layout and writes "<name> <size>" to `handlefd`
+// A named mapping only exists while a handle to it is open, so this waits for a line (or EOF) on STDIN,
+// which the consumer sends once it has opened the mapping itself
+int writeshm(mesh m, FILE* handlefd) {
+    static volatile LONG counter = 0;
+    size_t size = interopsize(m);
+
+    char name[64];
+    snprintf(name, sizeof(name), "Local\\swmeshexp-%lu-%ld", (unsigned long)GetCurrentProcessId(), InterlockedIncrement(&counter));
+
+    HANDLE mapping = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, size, name);
+    if (mapping == NULL) return 5;
+
+    char* view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if (view == NULL) {
+        CloseHandle(mapping);
+        return 5;
+    }
+    encodeinterop(m, view);
+    UnmapViewOfFile(view);
+
+    fprintf(handlefd, "%s %u\n", name, (unsigned)size);
+    fflush(handlefd);
+
+    char line[16];
+    fgets(line, sizeof(line), stdin);
+
+    CloseHandle(mapping);
+    return 0;
+}
+
+// Returns true if the `size` bytes at `offset` lie within a buffer of `len` bytes (without overflowing)
+bool inbounds(uint64_t offset, uint64_t size, uint64_t len) {
+    return offset <= len && size <= len - offset;
+}
+
+// Makes `m` a view of the interop-layout block `block` (of `size` bytes): vertices and triangles point into
+// the block and are not copied, only the submesh table is decoded. Returns non-zero if the block is invalid.
+int interopview(char* block, size_t size, mesh* m) {
+    interop_header h;
+    if (size < sizeof(h)) return 3;
+    memcpy(&h, block, sizeof(h));
+    if (memcmp(h.magic, INTEROP_SIGNATURE, 4) || h.version != 1) return 2;
+    if (h.total_size > size
+        || !inbounds(h.vertices_offset, (uint64_t)h.n_vertices * sizeof(vertex), size)
+        || !inbounds(h.triangles_offset, (uint64_t)h.n_triangles * sizeof(triangle), size)
+        || !inbounds(h.submeshes_offset, (uint64_t)h.n_submeshes * sizeof(interop_submesh), size)) return 3;
+
+    m->n_vertices = h.n_vertices;
+    m->vertices = (vertex*)&block[h.vertices_offset];
+    m->n_triangles = h.n_triangles;
+    m->triangles = (triangle*)&block[h.triangles_offset];
+    m->n_submeshes = h.n_submeshes;
+    m->submeshes = malloc(max(h.n_submeshes, 1) * sizeof(submesh));
+
+    for (int s = 0; s < h.n_submeshes; ++s) {
+        interop_submesh rec;
+        memcpy(&rec, &block[h.submeshes_offset + s * sizeof(interop_submesh)], sizeof(rec));
+
+        submesh sm = {
+            .start_index = rec.start_index,
+            .vertex_count = rec.vertex_count,
+            .shadertype = rec.shadertype,
+            .id = malloc(rec.id_length + 1)
+        };
+        memcpy(sm.cullmin, rec.cullmin, sizeof(sm.cullmin));
+        memcpy(sm.cullmax, rec.cullmax, sizeof(sm.cullmax));
+        if (inbounds(rec.id_offset, rec.id_length, size)) memcpy(sm.id, &block[rec.id_offset], rec.id_length);
+        else rec.id_length = 0;
+        sm.id[rec.id_length] = '\0';
+
+        m->submeshes[s] = sm;
+    }
+
+    return 0;
+}
+
+// Mesh pack (.swpack): many meshes in one file, each in the interop layout so it can be used directly from a mapping
+// header (32b), index (32b per entry, sorted by name hash then name), entry names, then the 16-byte aligned entries
+typedef struct pack_header {
+    char magic[4]; // "SWPK"
+    uint32_t version; // 1
+    uint32_t n_entries;
+    uint32_t reserved;
+    uint64_t index_offset;
+    uint64_t names_offset;
+} pack_header;
+
+typedef struct pack_entry {
+    uint64_t name_hash;
+    uint64_t offset; // Interop-layout block of the mesh
+    uint64_t size;
+    uint32_t name_offset;
+    uint32_t name_length;
+} pack_entry;
+
+// FNV-1a
+uint64_t namehash(const char* name, size_t len) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; ++i) h = (h ^ (uint8_t)name[i]) * 0x100000001b3ULL;
+    return h;
+}
+
+// Returns the index entry named `name` in the mapped pack `pack`, or NULL if there is none
+pack_entry* findpackentry(char* pack, size_t len, char* name) {
+    pack_header h;
+    memcpy(&h, pack, sizeof(h));
+    pack_entry* index = (pack_entry*)&pack[h.index_offset];
+    uint64_t hash = namehash(name, strlen(name));
+
+    // Binary search on (hash, name)
+    int lo = 0, hi = (int)h.n_entries - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        pack_entry* e = &index[mid];
+        int cmp = (e->name_hash < hash) ? -1 : (e->name_hash > hash) ? 1 : 0;
+        if (cmp == 0) {
+            // Names outside of the pack never match
+            if (!inbounds(e->name_offset, e->name_length, len)) return NULL;
+            cmp = strncmp(&pack[e->name_offset], name, e->name_length);
+            if (cmp == 0 && strlen(name) != e->name_length) cmp = -1;
+        }
+
+        if (cmp == 0) return e;
+        if (cmp < 0) lo = mid + 1;
+        else hi = mid - 1;
+    }
+    return NULL;
+}
+
+// Maps and validates the header and index of the pack `filename`, returns NULL on failure (with `*err` set)
+char* openpack(char* filename, size_t* len, bool copy_on_write, int* err) {
+    char* pack = mapfile(filename, len, copy_on_write);
+    if (pack == NULL) {
+        *err = 1;
+        return NULL;
+    }
+
+    pack_header h;
+    if (*len < sizeof(h)) {
+        *err = 3;
+    } else {
+        memcpy(&h, pack, sizeof(h));
+        if (memcmp(h.magic, PACK_SIGNATURE, 4) || h.version != 1) *err = 2;
+        else if (!inbounds(h.index_offset, (uint64_t)h.n_entries * sizeof(pack_entry), *len)) *err = 3;
+    }
+
+    if (*err) {
+        unmapfile(pack);
+        return NULL;
+    }
+    return pack;
+}
+
+// Loads the entry `<pack>.swpack:<entry name>` of a mesh pack
+// The pack is mapped copy-on-write and the vertices and triangles are used in place, without copying
+mesh readpack(char* spec, int* err) {
+    mesh m = { 0 };
+
+    char* sep = strstr(spec, PACK_ENTRY_SEP);
+    if (sep == NULL) {
+        printf("Error, pack entries must be given as <pack>" PACK_ENTRY_SEP "<entry>\n");
+        *err = 5;
+        return m;
+    }
+
+    size_t namelen = sep - spec + strlen(PACK_ENTRY_SEP) - 1;
+    char* filename = malloc(namelen + 1);
+    memcpy(filename, spec, namelen);
+    filename[namelen] = '\0';
+    char* name = sep + strlen(PACK_ENTRY_SEP);
+
+    size_t len = 0;
+    char* pack = openpack(filename, &len, true, err);
+    free(filename);
+    if (pack == NULL) return m;
+
+    pack_entry* e = findpackentry(pack, len, name);
+    if (e == NULL) {
+        *err = 4;
+    } else if (!inbounds(e->offset, e->size, len)) {
+        *err = 3;
+    } else {
+        *err = interopview(&pack[e->offset], e->size, &m);
+    }
+
+    if (*err) {
+        free(m.submeshes);
+        m = (mesh){ 0 };
+        unmapfile(pack);
+    } else {
+        m.view = pack;
+    }
+    return m;
+}
+
 // TODO: Phys file import
 mesh readphys(char* fbytes) {
-    mesh m;
+    mesh m = { 0 };
 
     return m;
 }
@@ -619,8 +1526,10 @@ int writephys(mesh m, FILE* destfd) {
 }
 
 // Loads the mesh data stored in `fbytes` (encoded in Stormworks .mesh format) 
+// Every count in the header is checked against the file size before it is used, truncated or
+// inconsistent files fail with error 3 instead of reading past the buffer
 mesh readmesh(char* filename, int* err) {
-    mesh m;
+    mesh m = { 0 };
     size_t len = 0;
 
     char* fbytes = readbytes(filename, &len);
@@ -629,13 +1538,20 @@ mesh readmesh(char* filename, int* err) {
         goto exit;
     }
 
-    fbytes[4] = '\0';
+    // "mesh" + 4 header, vertex count (2b), unknown (4b)
+    if (len < 14) {
+        printf("Error, \"%s\" is too short to be a mesh (%llu bytes)\n", filename, (unsigned long long)len);
+        *err = 3;
+        goto exit;
+    }
+
     // Incorrect signature
-    if (strcmp(fbytes, "mesh")) {
+    if (memcmp(fbytes, SIGNATURE, 4)) {
         *err = 2;
+        goto exit;
     }
 
-    int cursor = 8; // skip the first 8 bytes "mesh" + 4 header
+    size_t cursor = 8; // skip the first 8 bytes "mesh" + 4 header
 
     // Vertex count
     uint16_t vtxcount = *((uint16_t*)&fbytes[cursor]);
@@ -644,28 +1560,48 @@ mesh readmesh(char* filename, int* err) {
     // Unknown
     cursor += 4;
 
-    // Vertices
+    // Vertices, followed by the index count
+    if (cursor + vtxcount * sizeof(vertex) + 4 > len) {
+        printf("Error, \"%s\" is truncated: %d vertices do not fit in %llu bytes\n", filename, vtxcount, (unsigned long long)len);
+        *err = 3;
+        goto exit;
+    }
     vertex* verts_ptr = (vertex*)&fbytes[cursor];
-    vertex* verts = malloc(vtxcount * sizeof(vertex));
-    memcpy(verts, verts_ptr, vtxcount * sizeof(vertex));
+    m.n_vertices = vtxcount;
+    m.vertices = malloc(max(vtxcount, 1) * sizeof(vertex));
+    memcpy(m.vertices, verts_ptr, vtxcount * sizeof(vertex));
     cursor += vtxcount * sizeof(vertex);
 
     // Triangle (Face) count
-    uint32_t tricount = *((uint32_t*)&fbytes[cursor]) / 3;
+    uint32_t idxcount = *((uint32_t*)&fbytes[cursor]);
     cursor += 4;
+    if (idxcount % 3 || cursor + (uint64_t)idxcount * sizeof(uint16_t) + 2 > len) {
+        printf("Error, \"%s\" has an invalid index count (%u for a %llu byte file)\n", filename, idxcount, (unsigned long long)len);
+        *err = 3;
+        goto exit;
+    }
+    uint32_t tricount = idxcount / 3;
 
     // Edges (Triangles)
     triangle* tris_ptr = (triangle*)&fbytes[cursor];
-    triangle* tris = malloc(tricount * sizeof(triangle));
-    memcpy(tris, tris_ptr, tricount * sizeof(triangle));
+    m.n_triangles = tricount;
+    m.triangles = malloc(max(tricount, 1) * sizeof(triangle));
+    memcpy(m.triangles, tris_ptr, tricount * sizeof(triangle));
     cursor += tricount * sizeof(triangle);
 
     // Submesh count
     uint16_t submeshcount = *((uint16_t*)&fbytes[cursor]);
     cursor += 2;
-    submesh* submeshes = malloc(submeshcount * sizeof(submesh));
+    m.submeshes = malloc(max(submeshcount, 1) * sizeof(submesh));
 
     for (int s = 0; s < submeshcount; ++s) {
+        // Fixed part of the record, up to and including the ID length
+        if (cursor + 40 > len) {
+            printf("Error, \"%s\" is truncated in submesh #%d of %d\n", filename, s, submeshcount);
+            *err = 3;
+            goto exit;
+        }
+
         submesh sm;
         sm.start_index = *((uint32_t*)&fbytes[cursor]);
         cursor += 4;
@@ -688,6 +1624,12 @@ mesh readmesh(char* filename, int* err) {
         int idlen = (int)*((uint16_t*)&fbytes[cursor]);
         cursor += 2;
 
+        if (cursor + idlen + 12 > len) {
+            printf("Error, \"%s\" is truncated in submesh #%d of %d\n", filename, s, submeshcount);
+            *err = 3;
+            goto exit;
+        }
+
         sm.id = malloc(idlen + 1);
         memcpy(sm.id, &fbytes[cursor], idlen);
         sm.id[idlen] = '\0';
@@ -695,251 +1637,2962 @@ mesh readmesh(char* filename, int* err) {
 
         cursor += 12; // Padding
 
-        submeshes[s] = sm;
+        m.submeshes[m.n_submeshes++] = sm;
     }
 
-    m.n_vertices = vtxcount;
-    m.vertices = verts;
-    m.n_triangles = tricount;
-    m.triangles = tris;
-    m.n_submeshes = submeshcount;
-    m.submeshes = submeshes;
-
 exit:
+    if (*err) {
+        freemesh(&m);
+        m = (mesh){ 0 };
+    }
     if (fbytes != NULL) free(fbytes);
     return m;
 }
 
-// Writes `m` to destfd in Stormworks .mesh format
-int writemesh(mesh m, FILE* destfd) {
-    // Header
-    fwrite("mesh\x07\x00\x01\x00", 8, 1, destfd);
-
-    // Vertex count (2b)
-    uint16_t vertn = m.n_vertices;
-    fwrite(&vertn, 1, sizeof(uint16_t), destfd);
+// Loads only the submesh matching `sel` from the Stormworks .mesh file `filename`
+// The submesh table is located from the header counts, then only the submesh's triangle range and the
+// span of vertices it references are read, so the cost is proportional to the size of the submesh
+mesh readmesh_submesh(char* filename, submesh_selector sel, int* err) {
+    mesh m = { 0 };
+    vertex* verts = NULL;
+    triangle* tris = NULL;
+    submesh found = { .id = NULL };
+
+    FILE* fhandle = fopen(filename, "rb");
+    if (fhandle == NULL) {
+        *err = 1;
+        return m;
+    }
+
+    // "mesh" + 4 header, vertex count (2b), unknown (4b)
+    char header[14];
+    if (fread(header, sizeof(header), 1, fhandle) != 1) { *err = 3; goto exit; }
+    // Incorrect signature
+    if (memcmp(header, SIGNATURE, 4)) { *err = 2; goto exit; }
+    uint16_t vtxcount = *((uint16_t*)&header[8]);
+
+    long tricount_offset = sizeof(header) + (long)vtxcount * sizeof(vertex);
+    uint32_t idxcount;
+    fseek(fhandle, tricount_offset, SEEK_SET);
+    if (fread(&idxcount, sizeof(uint32_t), 1, fhandle) != 1) { *err = 3; goto exit; }
+    uint32_t tricount = idxcount / 3;
+
+    // Walk the submesh table (records are variable-length because of the ID)
+    fseek(fhandle, tricount_offset + 4 + (long)tricount * sizeof(triangle), SEEK_SET);
+    uint16_t submeshcount;
+    if (fread(&submeshcount, sizeof(uint16_t), 1, fhandle) != 1) { *err = 3; goto exit; }
+
+    for (int s = 0; s < submeshcount && found.id == NULL; ++s) {
+        // start (4b), count (4b), unknown (2b), shader (2b), cullmin (12b), cullmax (12b), unknown (2b), ID length (2b)
+        char rec[40];
+        if (fread(rec, sizeof(rec), 1, fhandle) != 1) { *err = 3; goto exit; }
+        uint16_t idlen = *((uint16_t*)&rec[38]);
+
+        char* id = malloc(idlen + 1);
+        if (fread(id, 1, idlen, fhandle) != idlen) { free(id); *err = 3; goto exit; }
+        id[idlen] = '\0';
+        fseek(fhandle, 12, SEEK_CUR); // Padding
+
+        if (!selector_matches(sel, s, id)) {
+            free(id);
+            continue;
+        }
+
+        found.start_index = *((uint32_t*)&rec[0]);
+        found.vertex_count = *((uint32_t*)&rec[4]);
+        found.shadertype = *((uint16_t*)&rec[10]);
+        memcpy(found.cullmin, &rec[12], 3 * sizeof(float));
+        memcpy(found.cullmax, &rec[24], 3 * sizeof(float));
+        found.id = id;
+    }
+
+    if (found.id == NULL) { *err = 4; goto exit; }
+    // The range must be whole faces within the index count
+    if (found.start_index % 3 || found.vertex_count % 3 || (uint64_t)found.start_index + found.vertex_count > (uint64_t)tricount * 3) {
+        *err = 3;
+        goto exit;
+    }
+
+    // Triangle range of the submesh
+    int n_tris = found.vertex_count / 3;
+    tris = malloc(max(n_tris, 1) * sizeof(triangle));
+    fseek(fhandle, tricount_offset + 4 + (long)(found.start_index / 3) * sizeof(triangle), SEEK_SET);
+    if (fread(tris, sizeof(triangle), n_tris, fhandle) != n_tris) { *err = 3; goto exit; }
+
+    int vmin = vtxcount, vmax = -1;
+    for (int t = 0; t < n_tris; ++t) {
+        for (int c = 0; c < 3; ++c) {
+            vmin = min(vmin, tris[t].i[c]);
+            vmax = max(vmax, tris[t].i[c]);
+        }
+    }
+    if (vmax < 0) vmin = vmax = 0;
+    if (vmax >= vtxcount && n_tris > 0) { *err = 3; goto exit; }
+
+    // Span of vertices referenced by the triangles
+    int vspan = vmax - vmin + 1;
+    verts = malloc(vspan * sizeof(vertex));
+    fseek(fhandle, sizeof(header) + (long)vmin * sizeof(vertex), SEEK_SET);
+    if (n_tris > 0 && fread(verts, sizeof(vertex), vspan, fhandle) != vspan) { *err = 3; goto exit; }
+
+    compact_triangles(verts, vmin, vspan, tris, n_tris, found, &m);
+
+exit:
+    fclose(fhandle);
+    free(verts);
+    free(tris);
+    free(found.id);
+    return m;
+}
+
+// Largest value of `n` 16-bit indices
+// SSE2 only has a signed 16-bit max, so the values are biased by 0x8000 into the signed range and back
+uint16_t maxindex(const uint16_t* idx, size_t n) {
+    const __m128i bias = _mm_set1_epi16((short)0x8000);
+    __m128i vmax = bias; // 0 biased
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i*)&idx[i]), bias);
+        vmax = _mm_max_epi16(vmax, x);
+    }
+    // Horizontal reduction of the 8 lanes
+    vmax = _mm_max_epi16(vmax, _mm_shuffle_epi32(vmax, _MM_SHUFFLE(1, 0, 3, 2)));
+    vmax = _mm_max_epi16(vmax, _mm_shuffle_epi32(vmax, _MM_SHUFFLE(2, 3, 0, 1)));
+    vmax = _mm_max_epi16(vmax, _mm_shufflelo_epi16(vmax, _MM_SHUFFLE(2, 3, 0, 1)));
+    uint16_t result = (uint16_t)(_mm_cvtsi128_si32(vmax) ^ 0x8000);
+
+    for (; i < n; ++i) result = max(result, idx[i]);
+    return result;
+}
+
+// A float is NaN or infinite when all of its exponent bits are set
+bool nonfinite(float f) {
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return (bits & 0x7f800000) == 0x7f800000;
+}
+
+// Checks the contents of a decoded .mesh against what the rest of the program relies on: indices below the
+// vertex count, finite positions, and submesh ranges and cull bounds matching the geometry
+// Every problem found is reported for `filename`, returns 6 if the mesh must be rejected
+int validatemesh(mesh m, char* filename) {
+    int err = 0;
+
+    // Indices, the common case of a valid mesh only costs one pass of the max-reduction
+    size_t n_indices = (size_t)m.n_triangles * 3;
+    if (n_indices > 0 && maxindex(&m.triangles[0].i[0], n_indices) >= m.n_vertices) {
+        int n_bad = 0, first = -1;
+        for (int t = 0; t < m.n_triangles; ++t) {
+            for (int c = 0; c < 3; ++c) {
+                if (m.triangles[t].i[c] < m.n_vertices) continue;
+                if (first < 0) first = t;
+                n_bad++;
+            }
+        }
+        printf("Error, \"%s\": %d triangle indices are out of range for %d vertices (first in face %d)\n",
+            filename, n_bad, m.n_vertices, first);
+        err = 6;
+    }
+
+    // Positions and normals
+    int n_badpos = 0, n_badnorm = 0, firstpos = -1, firstnorm = -1;
+    for (int v = 0; v < m.n_vertices; ++v) {
+        vertex* vtx = &m.vertices[v];
+        if (nonfinite(vtx->x) || nonfinite(vtx->y) || nonfinite(vtx->z)) {
+            if (firstpos < 0) firstpos = v;
+            n_badpos++;
+        }
+        if (nonfinite(vtx->nx) || nonfinite(vtx->ny) || nonfinite(vtx->nz)) {
+            if (firstnorm < 0) firstnorm = v;
+            n_badnorm++;
+        }
+    }
+    if (n_badpos) {
+        printf("Error, \"%s\": %d vertices have NaN or infinite positions (first is vertex %d)\n", filename, n_badpos, firstpos);
+        err = 6;
+    }
+    // Bad normals are filled in on import, so they don't make the mesh unusable
+    if (n_badnorm) {
+        printf("Warning, \"%s\": %d vertices have NaN or infinite normals (first is vertex %d)\n", filename, n_badnorm, firstnorm);
+    }
+
+    // Submeshes
+    int n_badcull = 0, firstcull = -1;
+    for (int s = 0; s < m.n_submeshes; ++s) {
+        submesh* sm = &m.submeshes[s];
+        if (sm->start_index % 3 || sm->vertex_count % 3 || (uint64_t)sm->start_index + sm->vertex_count > n_indices) {
+            printf("Error, \"%s\": submesh #%d (\"%s\") covers indices %u to %llu, which is not a range of whole faces within the %llu indices of the mesh\n",
+                filename, s, sm->id, sm->start_index, (unsigned long long)sm->start_index + sm->vertex_count, (unsigned long long)n_indices);
+            err = 6;
+            continue;
+        }
+
+        bool badcull = false;
+        for (int k = 0; k < 3; ++k) {
+            badcull |= nonfinite(sm->cullmin[k]) || nonfinite(sm->cullmax[k]) || sm->cullmin[k] > sm->cullmax[k];
+        }
+        if (badcull) {
+            printf("Error, \"%s\": submesh #%d (\"%s\") has invalid cull bounds\n", filename, s, sm->id);
+            err = 6;
+            continue;
+        }
+
+        // Geometry outside of the cull bounds would be culled while visible (the bounds are not rewritten
+        // unless the geometry is modified, so this is only reported)
+        if (err) continue;
+        float gmin[3] = { INFINITY, INFINITY, INFINITY }, gmax[3] = { -INFINITY, -INFINITY, -INFINITY };
+        for (uint32_t i = sm->start_index; i < sm->start_index + sm->vertex_count; ++i) {
+            vertex* vtx = &m.vertices[m.triangles[i / 3].i[i % 3]];
+            for (int k = 0; k < 3; ++k) {
+                gmin[k] = min(gmin[k], vtx->pos[k]);
+                gmax[k] = max(gmax[k], vtx->pos[k]);
+            }
+        }
+        for (int k = 0; k < 3; ++k) {
+            float eps = 1e-4f * (1.0f + max(fabsf(gmin[k]), fabsf(gmax[k])));
+            if (gmin[k] < sm->cullmin[k] - eps || gmax[k] > sm->cullmax[k] + eps) {
+                if (firstcull < 0) firstcull = s;
+                n_badcull++;
+                break;
+            }
+        }
+    }
+    if (n_badcull) {
+        printf("Warning, \"%s\": the cull bounds of %d submeshes do not enclose their geometry (first is submesh #%d)\n",
+            filename, n_badcull, firstcull);
+    }
+
+    return err;
+}
+
+// Returns the exact size in bytes of `m` encoded in Stormworks .mesh format
+size_t meshsize(mesh m) {
+    // Header (8b), vertex count (2b), unknown (4b), vertices, triangle count (4b), triangles, submesh count (2b)
+    size_t size = 8 + 2 + 4 + m.n_vertices * sizeof(vertex) + 4 + m.n_triangles * sizeof(triangle) + 2;
+
+    // Fixed part of every submesh (40b), ID and 3 unknown floats (12b)
+    for (int s = 0; s < m.n_submeshes; ++s) size += 40 + strlen(m.submeshes[s].id) + 12;
+
+    // Trailer (2b)
+    return size + 2;
+}
+
+// Encodes `m` in Stormworks .mesh format into `buf`, which must hold at least `meshsize(m)` bytes
+// Returns the number of bytes written
+size_t encodemesh(mesh m, char* buf) {
+    size_t cursor = 0;
+
+    // Header
+    memcpy(&buf[cursor], "mesh\x07\x00\x01\x00", 8);
+    cursor += 8;
+
+    // Vertex count (2b)
+    uint16_t vertn = m.n_vertices;
+    memcpy(&buf[cursor], &vertn, sizeof(uint16_t));
+    cursor += 2;
 
     // Unknown (4b)
-    fwrite("\x13\x00\x00\x00", 4, 1, destfd);
+    memcpy(&buf[cursor], "\x13\x00\x00\x00", 4);
+    cursor += 4;
 
     // Vertices
-    fwrite(m.vertices, m.n_vertices, sizeof(vertex), destfd);
+    memcpy(&buf[cursor], m.vertices, m.n_vertices * sizeof(vertex));
+    cursor += m.n_vertices * sizeof(vertex);
+
+    // Triangle count (4b) (n_triangles * 3)
+    uint32_t trin = m.n_triangles * 3;
+    memcpy(&buf[cursor], &trin, sizeof(uint32_t));
+    cursor += 4;
+
+    // "Edge buffer" (triangles)
+    memcpy(&buf[cursor], m.triangles, m.n_triangles * sizeof(triangle));
+    cursor += m.n_triangles * sizeof(triangle);
+
+    // Submesh count
+    uint16_t smct = m.n_submeshes;
+    memcpy(&buf[cursor], &smct, sizeof(uint16_t));
+    cursor += 2;
+
+    for (int s = 0; s < m.n_submeshes; ++s) {
+        submesh sm = m.submeshes[s];
+
+        // Vertices start (4b)
+        memcpy(&buf[cursor], &sm.start_index, sizeof(uint32_t));
+        cursor += 4;
+
+        // Vertices count (4b)
+        memcpy(&buf[cursor], &sm.vertex_count, sizeof(uint32_t));
+        cursor += 4;
+
+        // Unknown (2b)
+        memcpy(&buf[cursor], "\x00\x00", 2);
+        cursor += 2;
+
+        // Shader type (2b)
+        memcpy(&buf[cursor], &sm.shadertype, sizeof(uint16_t));
+        cursor += 2;
+
+        // Cullmin (3x4b)
+        memcpy(&buf[cursor], sm.cullmin, 3 * sizeof(float));
+        cursor += 3 * sizeof(float);
+
+        // Cullmax (3x4b)
+        memcpy(&buf[cursor], sm.cullmax, 3 * sizeof(float));
+        cursor += 3 * sizeof(float);
+
+        // Unknown (2b)
+        memcpy(&buf[cursor], "\x00\x00", 2);
+        cursor += 2;
+
+        // Submesh ID (2b+data)
+        uint16_t len = strlen(sm.id);
+        memcpy(&buf[cursor], &len, sizeof(uint16_t));
+        cursor += 2;
+        memcpy(&buf[cursor], sm.id, len);
+        cursor += len;
+
+        // 3 unknown floats (3x4b)
+        memcpy(&buf[cursor], "\x00\x00\x80\x3F\x00\x00\x80\x3F\x00\x00\x80\x3F", 12);
+        cursor += 12;
+    }
+
+    // Trailer (2b)
+    memcpy(&buf[cursor], "\x00\x00", 2);
+    cursor += 2;
+
+    return cursor;
+}
+
+// Writes `m` to destfd in Stormworks .mesh format
+// The whole file is encoded into one exactly-sized buffer first, so it is written with a single call
+int writemesh(mesh m, FILE* destfd) {
+    size_t size = meshsize(m);
+    char* buf = malloc(size);
+    if (buf == NULL) return 3;
+
+    encodemesh(m, buf);
+    size_t written = fwrite(buf, 1, size, destfd);
+    free(buf);
+
+    fflush(destfd);
+
+    return written == size ? 0 : 4;
+}
+
+int fixnormals(mesh* m, char* filename);
+
+// Step 1: Import a mesh
+// If `sel` is not NULL, only the selected submesh is kept (as a compacted standalone mesh)
+int importfile(char* input_filename, int input_mode, submesh_selector* sel, mesh* m) {
+    int err = 0;
+    switch (input_mode) {
+        case INPUT_MESH:
+            if (sel != NULL) {
+                // .mesh files can be read selectively without decoding the entire file
+                *m = readmesh_submesh(input_filename, *sel, &err);
+                sel = NULL;
+            } else {
+                *m = readmesh(input_filename, &err);
+            }
+            break;
+        case INPUT_OBJ:
+            *m = readobj(input_filename, &err);
+            break;
+        case INPUT_PLY:
+            *m = readply(input_filename, &err);
+            break;
+        case INPUT_PACK:
+            *m = readpack(input_filename, &err);
+            break;
+        case INPUT_TEXT:
+            *m = readtext(input_filename, &err);
+            break;
+    }
+
+    // Meshes and packs from untrusted sources may reference data they don't contain
+    if (!err && (input_mode == INPUT_MESH || input_mode == INPUT_PACK) && (err = validatemesh(*m, input_filename))) {
+        freemesh(m);
+        *m = (mesh){ 0 };
+    }
+
+    if (!err && sel != NULL) {
+        int s;
+        for (s = 0; s < m->n_submeshes; ++s) {
+            if (selector_matches(*sel, s, m->submeshes[s].id)) break;
+        }
+
+        if (s < m->n_submeshes) {
+            mesh full = *m;
+            extract_submesh(full, s, m);
+            freemesh(&full);
+        } else {
+            err = 4;
+        }
+    }
+
+    // Every conversion path starts here, so none of them writes out missing normals
+    if (!err && (err = fixnormals(m, input_filename))) {
+        freemesh(m);
+        *m = (mesh){ 0 };
+    }
+
+    if (err == 4) {
+        printf("Error, no submesh (or pack entry) matching the selection in file \"%s\"\n", input_filename);
+    } else if (err) {
+        printf("Error %d importing file \"%s\"\n", err, input_filename);
+    } else {
+        printf("Successfully imported \"%s\" with %d vertices and %d faces\n", input_filename, m->n_vertices, m->n_triangles);
+
+    }
+
+    return err;
+}
+
+typedef struct multi_export_ctx {
+    mesh m;
+    int output_mode;
+    char* outdir;
+    int* errors;
+    int* repeats; // Number of earlier submeshes with the same file name
+} multi_export_ctx;
+
+typedef struct named_submesh {
+    const char* id;
+    const char* shader;
+    int s;
+} named_submesh;
+
+// File names are compared case-insensitively (like the file system), ties keep the submesh order
+int cmp_named_submesh(const void* a, const void* b) {
+    const named_submesh* x = a;
+    const named_submesh* y = b;
+    int c = strcasecmp(x->id, y->id);
+    if (!c) c = strcmp(x->shader, y->shader);
+    return c ? c : x->s - y->s;
+}
+
+// Counts, for every submesh, the earlier submeshes that would be written to the same `<id>-<shader>` file
+// (e.g. OBJ groups sharing a name), so concurrent exports never open the same path
+int* count_repeated_names(mesh m) {
+    int* repeats = calloc(max(m.n_submeshes, 1), sizeof(int));
+    named_submesh* names = malloc(max(m.n_submeshes, 1) * sizeof(named_submesh));
+    for (int s = 0; s < m.n_submeshes; ++s) {
+        names[s] = (named_submesh){ m.submeshes[s].id, SHADER_TYPES[min(m.submeshes[s].shadertype, 3)], s };
+    }
+    qsort(names, m.n_submeshes, sizeof(named_submesh), cmp_named_submesh);
+
+    for (int i = 1; i < m.n_submeshes; ++i) {
+        if (!strcasecmp(names[i].id, names[i - 1].id) && names[i].shader == names[i - 1].shader) {
+            repeats[names[i].s] = repeats[names[i - 1].s] + 1;
+        }
+    }
+    free(names);
+    return repeats;
+}
+
+// Writes submesh #`s` of a multi-file export as a standalone file containing only the vertices it references
+void export_submesh(void* param, int s) {
+    multi_export_ctx* ctx = param;
+    submesh sm = ctx->m.submeshes[s];
+
+    const char* ext = OUT_EXTS[ctx->output_mode];
+    const char* shader = SHADER_TYPES[min(sm.shadertype, 3)];
+    // Repeated names get the submesh index appended, the first one keeps the plain name
+    char suffix[16] = "";
+    if (ctx->repeats[s]) snprintf(suffix, sizeof(suffix), "-%d", s);
+    int pathlen = snprintf(NULL, 0, "%s/%s-%s%s%s", ctx->outdir, sm.id, shader, suffix, ext) + 1;
+    char* path = malloc(pathlen);
+    snprintf(path, pathlen, "%s/%s-%s%s%s", ctx->outdir, sm.id, shader, suffix, ext);
+
+    mesh sub = { 0 };
+    extract_submesh(ctx->m, s, &sub);
+
+    FILE* outfile = fopen(path, ctx->output_mode == OUTPUT_MULTI_STORMWORKS ? "wb" : "w");
+    if (outfile == NULL) {
+        ctx->errors[s] = 2;
+    } else {
+        switch (ctx->output_mode) {
+            case OUTPUT_MULTI_PLY:
+                ctx->errors[s] = writeply(sub, outfile);
+                break;
+            case OUTPUT_MULTI_OBJ:
+                ctx->errors[s] = writeobj(sub, outfile);
+                break;
+            case OUTPUT_MULTI_STORMWORKS:
+                ctx->errors[s] = writemesh(sub, outfile);
+                break;
+        }
+        fclose(outfile);
+    }
+
+    freemesh(&sub);
+    free(path);
+}
+
+// Step 3: Export the mesh after processing
+// If `output_filename` is NULL, it is derived from `input_filename` with the extension of `output_mode`
+int exportfile(char* input_filename, char* output_filename, mesh m, int output_mode, bool cout) {
+    int err = 0;
+    char* derived_filename = NULL;
+
+    if (output_filename == NULL) {
+        derived_filename = chgfname(input_filename, output_mode);
+        output_filename = derived_filename;
+    }
+
+    if (output_mode == OUTPUT_MULTI_PLY || output_mode == OUTPUT_MULTI_OBJ || output_mode == OUTPUT_MULTI_STORMWORKS) {
+        multi_export_ctx ctx = {
+            .m = m,
+            .output_mode = output_mode,
+            .errors = calloc(max(m.n_submeshes, 1), sizeof(int)),
+            .repeats = count_repeated_names(m)
+        };
+
+        // The output directory is named after the output file, without its extension
+        ctx.outdir = malloc(strlen(output_filename) + 1);
+        strcpy(ctx.outdir, output_filename);
+        char* ext = strrchr(ctx.outdir, '.');
+        if (ext != NULL && strpbrk(ext, "/\\") == NULL) *ext = '\0';
+
+        CreateDirectory(ctx.outdir, NULL);
+
+        // Submeshes are independent of each other, so they are compacted and written concurrently
+        parallel_for(m.n_submeshes, export_submesh, &ctx);
+
+        for (int s = 0; s < m.n_submeshes && !err; ++s) err = ctx.errors[s];
+
+        free(ctx.errors);
+        free(ctx.repeats);
+        free(ctx.outdir);
+    } else if (output_mode == OUTPUT_NONE) {
+        // Do nothing!
+    } else {
+        FILE* outfile;
+        if (cout) {
+            outfile = cout_stream;
+        } else {
+            outfile = fopen(output_filename, (output_mode == OUTPUT_STORMWORKS || output_mode == OUTPUT_GLB || output_mode == OUTPUT_INTEROP) ? "wb" : "w");
+            if (outfile == NULL) {
+                err = 2;
+                goto exit;
+            }
+        }
+
+        switch (output_mode) {
+            case OUTPUT_PLY:
+                err = writeply(m, outfile);
+                break;
+            case OUTPUT_OBJ:
+                err = writeobj(m, outfile);
+                break;
+            case OUTPUT_STORMWORKS:
+                err = writemesh(m, outfile);
+                break;
+            case OUTPUT_TEXT:
+                err = writedebug(m, outfile);
+                break;
+            case OUTPUT_GLB:
+                err = writeglb(m, outfile);
+                break;
+            case OUTPUT_INTEROP:
+                err = cout ? writeshm(m, outfile) : writeinterop(m, outfile);
+                break;
+            default:
+                break;
+        }
+
+        fflush(outfile);
+        if (!cout) fclose(outfile);
+    }
+
+exit:
+    if (err) printf("Error #%d exporting mesh %s\n", err, output_filename);
+    free(derived_filename);
+    // freemesh(&m);
+    return err;
+}
+
+#define MAX_OUTPUTS 10 // One of every output mode
+
+typedef struct fanout_ctx {
+    char* input_filename;
+    char** output_filenames;
+    int n_output_filenames;
+    mesh m;
+    int* output_modes;
+    bool cout;
+    int* errors;
+} fanout_ctx;
+
+void export_output(void* param, int i) {
+    fanout_ctx* ctx = param;
+
+    // Outputs without an explicit filename are named after the first given output (or the input if there is none)
+    char* namebase = ctx->n_output_filenames > 0 ? ctx->output_filenames[0] : ctx->input_filename;
+    char* output_filename = i < ctx->n_output_filenames ? ctx->output_filenames[i] : NULL;
+
+    ctx->errors[i] = exportfile(namebase, output_filename, ctx->m, ctx->output_modes[i], ctx->cout);
+}
+
+// Exports `m` once for every one of the `n_output_modes` output modes, serializers run concurrently
+// (except when writing to STDOUT, where the outputs are written one after the other)
+int exportmulti(char* input_filename, char** output_filenames, int n_output_filenames, mesh m, int* output_modes, int n_output_modes, bool cout) {
+    int errors[MAX_OUTPUTS] = { 0 };
+    fanout_ctx ctx = {
+        .input_filename = input_filename,
+        .output_filenames = output_filenames,
+        .n_output_filenames = n_output_filenames,
+        .m = m,
+        .output_modes = output_modes,
+        .cout = cout,
+        .errors = errors
+    };
+
+    // Print general information about the mesh to be exported
+    printf("Mesh processed with %d vertices and %d faces\n", m.n_vertices, m.n_triangles);
+    for (int i = 0; i < m.n_submeshes; ++i) {
+        printf(
+            "Submesh \"%s\" starting at face %d containing %d faces using shader #%d (%s)\n",
+            m.submeshes[i].id,
+            m.submeshes[i].start_index / 3,
+            m.submeshes[i].vertex_count / 3,
+            m.submeshes[i].shadertype,
+            SHADER_TYPES[min(m.submeshes[i].shadertype, 3)]
+        );
+    }
+
+    if (cout || n_output_modes == 1) {
+        for (int i = 0; i < n_output_modes; ++i) export_output(&ctx, i);
+    } else {
+        parallel_for(n_output_modes, export_output, &ctx);
+    }
+
+    for (int i = 0; i < n_output_modes; ++i) {
+        if (errors[i]) return errors[i];
+    }
+    return 0;
+}
+
+// Splits the comma-separated list `list` (in-place) into at most `maxn` elements of `items`
+// Returns the number of elements, or -1 if the list has more than `maxn`
+int splitlist(char* list, char** items, int maxn) {
+    int n = 0;
+    for (char* item = strtok(list, ","); item != NULL; item = strtok(NULL, ",")) {
+        if (n == maxn) return -1;
+        items[n++] = item;
+    }
+    return n;
+}
+
+// Returns the output mode named `name`, or -1 if the name is not valid
+int parse_output_mode(char* name) {
+    if (!strcasecmp(name, "obj")) {
+        return OUTPUT_OBJ;
+    } else if (!strcasecmp(name, "ply")) {
+        return OUTPUT_PLY;
+    } else if (!strcasecmp(name, "mesh") || !strcasecmp(name, "stormworks")) {
+        return OUTPUT_STORMWORKS;
+    } else if (!strcasecmp(name, "plys") || !strcasecmp(name, "multiply")) {
+        return OUTPUT_MULTI_PLY;
+    } else if (!strcasecmp(name, "objs") || !strcasecmp(name, "multiobj")) {
+        return OUTPUT_MULTI_OBJ;
+    } else if (!strcasecmp(name, "meshes") || !strcasecmp(name, "multimesh")) {
+        return OUTPUT_MULTI_STORMWORKS;
+    } else if (!strcasecmp(name, "text")) {
+        return OUTPUT_TEXT;
+    } else if (!strcasecmp(name, "glb") || !strcasecmp(name, "gltf")) {
+        return OUTPUT_GLB;
+    } else if (!strcasecmp(name, "shm") || !strcasecmp(name, "interop")) {
+        return OUTPUT_INTEROP;
+    } else if (!strcasecmp(name, "dryrun")) {
+        return OUTPUT_NONE;
+    }
+    return -1;
+}
+
+// Vertex attributes in separate arrays (structure of arrays), the working representation while processing a mesh
+// All arrays are 16-byte aligned and padded to a multiple of 4 vertices, so kernels can work on 4 vertices at a time
+typedef struct vertex_soa {
+    int n_vertices;
+    int capacity;
+    float* pos[3];
+    float* norm[3];
+    uint32_t* col; // RGBA bytes, as in `vertex`
+    void* block; // Single allocation holding every array
+} vertex_soa;
+
+#define SOA_ARRAYS 7
+
+// Grows `v` to hold at least `capacity` vertices, keeping its contents
+void soa_reserve(vertex_soa* v, int capacity) {
+    if (v->block != NULL && capacity <= v->capacity) return;
+    capacity = max((max(capacity, v->capacity * 2) + 3) & ~3, 4);
+
+    char* block = _aligned_malloc((size_t)capacity * sizeof(float) * SOA_ARRAYS, 16);
+    float* arrays[SOA_ARRAYS];
+    for (int a = 0; a < SOA_ARRAYS; ++a) arrays[a] = (float*)(block + (size_t)a * capacity * sizeof(float));
+
+    if (v->block != NULL) {
+        float* old[SOA_ARRAYS] = { v->pos[0], v->pos[1], v->pos[2], v->norm[0], v->norm[1], v->norm[2], (float*)v->col };
+        for (int a = 0; a < SOA_ARRAYS; ++a) memcpy(arrays[a], old[a], v->n_vertices * sizeof(float));
+        _aligned_free(v->block);
+    }
+
+    v->block = block;
+    v->capacity = capacity;
+    for (int i = 0; i < 3; ++i) {
+        v->pos[i] = arrays[i];
+        v->norm[i] = arrays[3 + i];
+    }
+    v->col = (uint32_t*)arrays[6];
+}
+
+void soa_free(vertex_soa* v) {
+    _aligned_free(v->block);
+    v->block = NULL;
+}
+
+// Copies vertex `src` of `v` to `dst`
+void soa_copy(vertex_soa* v, int dst, int src) {
+    for (int i = 0; i < 3; ++i) {
+        v->pos[i][dst] = v->pos[i][src];
+        v->norm[i][dst] = v->norm[i][src];
+    }
+    v->col[dst] = v->col[src];
+}
+
+// Converts the vertices of `m` to a newly-allocated structure of arrays
+// Every vertex is 7 floats (the color block moved as a float), so 4 vertices are two 4x4 transposes:
+// of the first 4 floats of each (XYZ, color) and of the last 4 (color, normal XYZ)
+void soa_from_mesh(mesh m, vertex_soa* v) {
+    *v = (vertex_soa){ 0 };
+    soa_reserve(v, m.n_vertices);
+    v->n_vertices = m.n_vertices;
+
+    float* src = (float*)m.vertices;
+    int i = 0;
+    for (; i + 4 <= m.n_vertices; i += 4) {
+        float* p = &src[i * 7];
+        __m128 a0 = _mm_loadu_ps(p), a1 = _mm_loadu_ps(p + 7), a2 = _mm_loadu_ps(p + 14), a3 = _mm_loadu_ps(p + 21);
+        __m128 b0 = _mm_loadu_ps(p + 3), b1 = _mm_loadu_ps(p + 10), b2 = _mm_loadu_ps(p + 17), b3 = _mm_loadu_ps(p + 24);
+        _MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+        _MM_TRANSPOSE4_PS(b0, b1, b2, b3);
+
+        _mm_store_ps(&v->pos[0][i], a0);
+        _mm_store_ps(&v->pos[1][i], a1);
+        _mm_store_ps(&v->pos[2][i], a2);
+        _mm_store_ps((float*)&v->col[i], a3);
+        _mm_store_ps(&v->norm[0][i], b1);
+        _mm_store_ps(&v->norm[1][i], b2);
+        _mm_store_ps(&v->norm[2][i], b3);
+    }
+    for (; i < m.n_vertices; ++i) {
+        for (int a = 0; a < 3; ++a) {
+            v->pos[a][i] = m.vertices[i].pos[a];
+            v->norm[a][i] = m.vertices[i].norm[a];
+        }
+        memcpy(&v->col[i], m.vertices[i].col, 4);
+    }
+}
+
+// Converts `v` back into the vertices of `m` (which are reallocated if the vertex count changed)
+void soa_to_mesh(vertex_soa* v, mesh* m) {
+    if (v->n_vertices != m->n_vertices) {
+        ownmesh(m);
+        m->vertices = realloc(m->vertices, max(v->n_vertices, 1) * sizeof(vertex));
+        m->n_vertices = v->n_vertices;
+    }
+
+    float* dst = (float*)m->vertices;
+    int i = 0;
+    for (; i + 4 <= v->n_vertices; i += 4) {
+        float* p = &dst[i * 7];
+        __m128 a0 = _mm_load_ps(&v->pos[0][i]), a1 = _mm_load_ps(&v->pos[1][i]), a2 = _mm_load_ps(&v->pos[2][i]), a3 = _mm_load_ps((float*)&v->col[i]);
+        __m128 b0 = a3, b1 = _mm_load_ps(&v->norm[0][i]), b2 = _mm_load_ps(&v->norm[1][i]), b3 = _mm_load_ps(&v->norm[2][i]);
+        _MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+        _MM_TRANSPOSE4_PS(b0, b1, b2, b3);
+
+        // Both halves of a vertex contain its color, so the overlapping stores agree
+        _mm_storeu_ps(p, a0);
+        _mm_storeu_ps(p + 3, b0);
+        _mm_storeu_ps(p + 7, a1);
+        _mm_storeu_ps(p + 10, b1);
+        _mm_storeu_ps(p + 14, a2);
+        _mm_storeu_ps(p + 17, b2);
+        _mm_storeu_ps(p + 21, a3);
+        _mm_storeu_ps(p + 24, b3);
+    }
+    for (; i < v->n_vertices; ++i) {
+        for (int a = 0; a < 3; ++a) {
+            m->vertices[i].pos[a] = v->pos[a][i];
+            m->vertices[i].norm[a] = v->norm[a][i];
+        }
+        memcpy(m->vertices[i].col, &v->col[i], 4);
+    }
+}
+
+// Recalculates the bounding box of each submesh of `m` from the vertices (in `v`) referenced by its triangles
+// Referenced vertices are marked in a mask, then the span between the lowest and highest is reduced 4 at a time
+void soa_submesh_bounds(mesh* m, vertex_soa* v) {
+    uint32_t* used = _aligned_malloc(max(v->capacity, 4) * sizeof(uint32_t), 16);
+    memset(used, 0, max(v->capacity, 4) * sizeof(uint32_t));
+    const __m128 inf = _mm_set1_ps(INFINITY), neginf = _mm_set1_ps(-INFINITY);
+
+    for (int s = 0; s < m->n_submeshes; ++s) {
+        submesh* sm = &m->submeshes[s];
+        int vmin = v->n_vertices, vmax = -1;
+        for (int j = sm->start_index; j < sm->start_index + sm->vertex_count && j / 3 < m->n_triangles; ++j) {
+            int o = m->triangles[j / 3].i[j % 3];
+            if (o >= v->n_vertices) continue;
+            used[o] = 0xFFFFFFFF;
+            vmin = min(vmin, o);
+            vmax = max(vmax, o);
+        }
+        if (vmax < 0) continue;
+
+        __m128 lo[3] = { inf, inf, inf }, hi[3] = { neginf, neginf, neginf };
+        for (int i = vmin & ~3; i <= vmax; i += 4) {
+            __m128 mask = _mm_load_ps((float*)&used[i]);
+            for (int a = 0; a < 3; ++a) {
+                __m128 p = _mm_load_ps(&v->pos[a][i]);
+                lo[a] = _mm_min_ps(lo[a], _mm_or_ps(_mm_and_ps(mask, p), _mm_andnot_ps(mask, inf)));
+                hi[a] = _mm_max_ps(hi[a], _mm_or_ps(_mm_and_ps(mask, p), _mm_andnot_ps(mask, neginf)));
+            }
+        }
+        memset(&used[vmin], 0, (vmax - vmin + 1) * sizeof(uint32_t));
+
+        for (int a = 0; a < 3; ++a) {
+            float l[4], h[4];
+            _mm_storeu_ps(l, lo[a]);
+            _mm_storeu_ps(h, hi[a]);
+            sm->cullmin[a] = min(min(l[0], l[1]), min(l[2], l[3]));
+            sm->cullmax[a] = max(max(h[0], h[1]), max(h[2], h[3]));
+        }
+    }
+
+    _aligned_free(used);
+}
+
+// Swaps two axes of the positions and normals (only the arrays are exchanged)
+int swapaxes(vertex_soa* v, char* argument) {
+    if (strlen(argument) != 2) {
+        printf("Error swapping axes: exactly 2 axes must be provided\n");
+        return 1;
+    }
+
+    int axis1 = argument[0] - 'X';
+    int axis2 = argument[1] - 'X';
+
+    if (((axis1 < 0) || (axis1 > 2)) || ((axis2 < 0) || (axis2 > 2))) {
+        printf("Error swapping axes: invalid axes to swap \'%c\' and \'%c\'", argument[0], argument[1]);
+        return 2;
+    }
+
+    float* tmp = v->pos[axis1];
+    v->pos[axis1] = v->pos[axis2];
+    v->pos[axis2] = tmp;
+
+    tmp = v->norm[axis1];
+    v->norm[axis1] = v->norm[axis2];
+    v->norm[axis2] = tmp;
+
+    printf("Successfully swapped %c and %c axes.\n", axis1 + 'X', axis2 + 'X');
+
+    return 0;
+}
+
+// Smoothing angle (in degrees) used when normals are generated automatically
+#define DEFAULT_SMOOTH_ANGLE 60.0f
+
+// Flags (in `bad`, padded like the arrays of `v`) the vertices used by triangles whose normal is missing (zero) or not finite
+// Returns the number of flagged vertices, and the number of vertices used by triangles in `n_used`
+int findbadnormals(mesh m, vertex_soa* v, uint8_t* bad, int* n_used) {
+    uint8_t* used = calloc(max(v->n_vertices, 1), 1);
+    for (int t = 0; t < m.n_triangles; ++t) {
+        for (int c = 0; c < 3; ++c) {
+            if (m.triangles[t].i[c] < v->n_vertices) used[m.triangles[t].i[c]] = 1;
+        }
+    }
+
+    const __m128 eps = _mm_set1_ps(1e-12f), inf = _mm_set1_ps(INFINITY);
+    for (int i = 0; i < v->n_vertices; i += 4) {
+        __m128 nx = _mm_load_ps(&v->norm[0][i]), ny = _mm_load_ps(&v->norm[1][i]), nz = _mm_load_ps(&v->norm[2][i]);
+        __m128 len = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz));
+        // Comparisons with NaN are false, so NaN normals are bad too
+        int good = _mm_movemask_ps(_mm_and_ps(_mm_cmpgt_ps(len, eps), _mm_cmplt_ps(len, inf)));
+        for (int k = 0; k < 4; ++k) bad[i + k] = !((good >> k) & 1);
+    }
+
+    int n_bad = 0;
+    *n_used = 0;
+    for (int i = 0; i < v->n_vertices; ++i) {
+        bad[i] &= used[i];
+        n_bad += bad[i];
+        *n_used += used[i];
+    }
+    free(used);
+    return n_bad;
+}
+
+typedef struct normals_ctx {
+    mesh* m;
+    vertex_soa* v;
+    float* facenormals[3]; // Per triangle, not normalized (length is twice the triangle's area)
+    float* cornerangles; // Per triangle corner, in radians
+
+    // Vertices at the same position are grouped under the lowest-indexed of them,
+    // found through a position hash table (bucket b holds bucket_items[bucket_start[b]..bucket_start[b + 1]))
+    uint32_t mask;
+    int* bucket_start;
+    int* bucket_items;
+    int* group;
+
+    // Triangle corners around each group (group g has corners[corner_start[g]..corner_start[g + 1]))
+    int* corner_start;
+    int* corners;
+
+    float cosangle; // Adjacent faces are only smoothed together if their normals are within the angle
+    float (*cornernormals)[3]; // Result, per triangle corner
+} normals_ctx;
+
+#define NORMALS_BLOCK 4096
+
+void face_block(void* param, int block) {
+    normals_ctx* ctx = param;
+    mesh* m = ctx->m;
+    vertex_soa* v = ctx->v;
+    int end = min((block + 1) * NORMALS_BLOCK, m->n_triangles);
+    for (int t = block * NORMALS_BLOCK; t < end; ++t) {
+        float p[3][3];
+        for (int c = 0; c < 3; ++c) {
+            for (int i = 0; i < 3; ++i) p[c][i] = v->pos[i][m->triangles[t].i[c]];
+        }
+
+        float e1[3], e2[3];
+        for (int i = 0; i < 3; ++i) {
+            e1[i] = p[1][i] - p[0][i];
+            e2[i] = p[2][i] - p[0][i];
+        }
+        float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+        for (int i = 0; i < 3; ++i) ctx->facenormals[i][t] = n[i];
+        float area2 = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+        // Interior angle of each corner, from the edges leaving it
+        for (int c = 0; c < 3; ++c) {
+            float a[3], b[3];
+            for (int i = 0; i < 3; ++i) {
+                a[i] = p[(c + 1) % 3][i] - p[c][i];
+                b[i] = p[(c + 2) % 3][i] - p[c][i];
+            }
+            ctx->cornerangles[t * 3 + c] = atan2f(area2, a[0] * b[0] + a[1] * b[1] + a[2] * b[2]);
+        }
+    }
+}
+
+uint32_t positionhash(vertex_soa* v, int i) {
+    // Adding zero turns -0 into +0, so positions that compare equal hash the same
+    float pos[3] = { v->pos[0][i] + 0.0f, v->pos[1][i] + 0.0f, v->pos[2][i] + 0.0f };
+    uint32_t h[3];
+    memcpy(h, pos, sizeof(h));
+    uint32_t x = h[0] * 0x9e3779b1u ^ h[1] * 0x85ebca77u ^ h[2] * 0xc2b2ae3du;
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    return x;
+}
+
+void group_block(void* param, int block) {
+    normals_ctx* ctx = param;
+    vertex_soa* v = ctx->v;
+    int end = min((block + 1) * NORMALS_BLOCK, v->n_vertices);
+    for (int i = block * NORMALS_BLOCK; i < end; ++i) {
+        uint32_t b = positionhash(v, i) & ctx->mask;
+
+        // Buckets are filled in vertex order, so the first equal position is the group's lowest vertex
+        ctx->group[i] = i;
+        for (int k = ctx->bucket_start[b]; k < ctx->bucket_start[b + 1]; ++k) {
+            int o = ctx->bucket_items[k];
+            if (v->pos[0][o] == v->pos[0][i] && v->pos[1][o] == v->pos[1][i] && v->pos[2][o] == v->pos[2][i]) {
+                ctx->group[i] = o;
+                break;
+            }
+        }
+    }
+}
+
+// Every corner gathers the area and angle weighted normals of the faces around its position,
+// so no two threads write to the same normal
+void corner_block(void* param, int block) {
+    normals_ctx* ctx = param;
+    mesh* m = ctx->m;
+    int end = min((block + 1) * NORMALS_BLOCK, m->n_triangles * 3);
+    for (int k = block * NORMALS_BLOCK; k < end; ++k) {
+        int t = k / 3;
+        float fn[3] = { ctx->facenormals[0][t], ctx->facenormals[1][t], ctx->facenormals[2][t] };
+        float fnlen = sqrtf(fn[0] * fn[0] + fn[1] * fn[1] + fn[2] * fn[2]);
+        float n[3] = { 0, 0, 0 };
+
+        if (fnlen > 0 && ctx->cosangle < 1.0f) {
+            int g = ctx->group[m->triangles[t].i[k % 3]];
+            for (int j = ctx->corner_start[g]; j < ctx->corner_start[g + 1]; ++j) {
+                int other = ctx->corners[j];
+                float on[3] = { ctx->facenormals[0][other / 3], ctx->facenormals[1][other / 3], ctx->facenormals[2][other / 3] };
+                float onlen = sqrtf(on[0] * on[0] + on[1] * on[1] + on[2] * on[2]);
+                if (!(onlen > 0)) continue;
+                if ((fn[0] * on[0] + fn[1] * on[1] + fn[2] * on[2]) < ctx->cosangle * fnlen * onlen) continue;
+
+                // Face normal length is twice the face area
+                float w = ctx->cornerangles[other];
+                for (int i = 0; i < 3; ++i) n[i] += on[i] * w;
+            }
+        }
+
+        float len = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (!(len > 0)) { // Flat, or nothing to smooth with
+            for (int i = 0; i < 3; ++i) n[i] = fn[i];
+            len = fnlen;
+        }
+        for (int i = 0; i < 3; ++i) ctx->cornernormals[k][i] = (len > 0) ? n[i] / len : 0;
+    }
+}
+
+// Replaces the normals of `m` (vertices in `v`) with generated ones. Faces meeting at a vertex position at less
+// than `angle` degrees are smoothed together, weighted by face area and corner angle (0 gives flat shading).
+// Vertices shared by faces that end up with different normals are split.
+int gennormals(mesh* m, vertex_soa* v, float angle) {
+    normals_ctx ctx = { .m = m, .v = v, .cosangle = (angle > 0) ? cosf(min(angle, 180.0f) * 3.14159265f / 180.0f) : 1.0f };
+    int n_corners = m->n_triangles * 3;
+    int n_original = v->n_vertices;
+
+    for (int t = 0; t < m->n_triangles; ++t) {
+        if (m->triangles[t].a >= v->n_vertices || m->triangles[t].b >= v->n_vertices || m->triangles[t].c >= v->n_vertices) {
+            printf("Error generating normals: triangle %d references a vertex out of range\n", t);
+            return 1;
+        }
+    }
+
+    // Step 1: Face normals and corner angles
+    for (int i = 0; i < 3; ++i) ctx.facenormals[i] = malloc(max(m->n_triangles, 1) * sizeof(float));
+    ctx.cornerangles = malloc(max(n_corners, 1) * sizeof(float));
+    parallel_for((m->n_triangles + NORMALS_BLOCK - 1) / NORMALS_BLOCK, face_block, &ctx);
+
+    // Step 2: Group vertices by position (counting sort into hash buckets)
+    uint32_t n_buckets = 1;
+    while (n_buckets < (uint32_t)v->n_vertices * 2) n_buckets <<= 1;
+    ctx.mask = n_buckets - 1;
+    ctx.bucket_start = calloc(n_buckets + 1, sizeof(int));
+    ctx.bucket_items = malloc(max(v->n_vertices, 1) * sizeof(int));
+    for (int i = 0; i < v->n_vertices; ++i) ctx.bucket_start[(positionhash(v, i) & ctx.mask) + 1]++;
+    for (uint32_t b = 0; b < n_buckets; ++b) ctx.bucket_start[b + 1] += ctx.bucket_start[b];
+    int* fill = malloc(max(n_buckets, v->n_vertices + 1) * sizeof(int));
+    memcpy(fill, ctx.bucket_start, n_buckets * sizeof(int));
+    for (int i = 0; i < v->n_vertices; ++i) ctx.bucket_items[fill[positionhash(v, i) & ctx.mask]++] = i;
+
+    ctx.group = malloc(max(v->n_vertices, 1) * sizeof(int));
+    parallel_for((v->n_vertices + NORMALS_BLOCK - 1) / NORMALS_BLOCK, group_block, &ctx);
+
+    // Step 3: Corners around each position group (prefix sums over the corner counts)
+    ctx.corner_start = calloc(v->n_vertices + 1, sizeof(int));
+    ctx.corners = malloc(max(n_corners, 1) * sizeof(int));
+    for (int k = 0; k < n_corners; ++k) ctx.corner_start[ctx.group[m->triangles[k / 3].i[k % 3]] + 1]++;
+    for (int i = 0; i < v->n_vertices; ++i) ctx.corner_start[i + 1] += ctx.corner_start[i];
+    memcpy(fill, ctx.corner_start, v->n_vertices * sizeof(int));
+    for (int k = 0; k < n_corners; ++k) ctx.corners[fill[ctx.group[m->triangles[k / 3].i[k % 3]]]++] = k;
+    free(fill);
+
+    // Step 4: Corner normals
+    ctx.cornernormals = malloc(max(n_corners, 1) * sizeof(*ctx.cornernormals));
+    parallel_for((n_corners + NORMALS_BLOCK - 1) / NORMALS_BLOCK, corner_block, &ctx);
+
+    // Step 5: Assign the normals to vertices, splitting vertices whose corners disagree
+    // Copies of a vertex are chained through `next` so corners with the same normal can share one
+    int capacity = max(n_original, 1);
+    int* next = malloc(capacity * sizeof(int));
+    bool* assigned = calloc(capacity, sizeof(bool));
+    uint16_t* indices = malloc(max(n_corners, 1) * sizeof(uint16_t));
+    bool split = true;
+
+    for (int k = 0; k < n_corners && split; ++k) {
+        int o = m->triangles[k / 3].i[k % 3];
+        float* cn = ctx.cornernormals[k];
+        if (!assigned[o]) {
+            for (int i = 0; i < 3; ++i) v->norm[i][o] = cn[i];
+            assigned[o] = true;
+            next[o] = -1;
+            indices[k] = o;
+            continue;
+        }
+
+        int copy = o, last = o;
+        for (; copy >= 0; last = copy, copy = next[copy]) {
+            if (v->norm[0][copy] == cn[0] && v->norm[1][copy] == cn[1] && v->norm[2][copy] == cn[2]) break;
+        }
+        if (copy < 0) {
+            if (v->n_vertices >= UINT16_MAX) {
+                split = false;
+                break;
+            }
+            if (v->n_vertices == capacity) {
+                capacity *= 2;
+                next = realloc(next, capacity * sizeof(int));
+            }
+            soa_reserve(v, v->n_vertices + 1);
+            copy = v->n_vertices++;
+            soa_copy(v, copy, o);
+            for (int i = 0; i < 3; ++i) v->norm[i][copy] = cn[i];
+            next[copy] = -1;
+            next[last] = copy;
+        }
+        indices[k] = copy;
+    }
+
+    if (split) {
+        for (int k = 0; k < n_corners; ++k) m->triangles[k / 3].i[k % 3] = indices[k];
+        printf("Generated %s normals for %d vertices (%d added by splitting).\n", (ctx.cosangle < 1.0f) ? "smooth" : "flat", n_original, v->n_vertices - n_original);
+    } else {
+        // Indices are 16-bit, so the vertices can't be split: each vertex gets the average of its corners instead
+        v->n_vertices = n_original;
+        float (*sums)[3] = calloc(n_original, sizeof(*sums));
+        for (int k = 0; k < n_corners; ++k) {
+            for (int i = 0; i < 3; ++i) sums[m->triangles[k / 3].i[k % 3]][i] += ctx.cornernormals[k][i];
+        }
+        for (int o = 0; o < n_original; ++o) {
+            float len = sqrtf(sums[o][0] * sums[o][0] + sums[o][1] * sums[o][1] + sums[o][2] * sums[o][2]);
+            for (int i = 0; i < 3; ++i) v->norm[i][o] = (len > 0) ? sums[o][i] / len : 0;
+        }
+        free(sums);
+        printf("Warning: generated normals are averaged per vertex, splitting vertices would exceed %d vertices.\n", UINT16_MAX);
+    }
+
+    free(next);
+    free(assigned);
+    free(indices);
+    for (int i = 0; i < 3; ++i) free(ctx.facenormals[i]);
+    free(ctx.cornerangles);
+    free(ctx.bucket_start);
+    free(ctx.bucket_items);
+    free(ctx.group);
+    free(ctx.corner_start);
+    free(ctx.corners);
+    free(ctx.cornernormals);
+    return 0;
+}
+
+// Fixes the missing or invalid normals of an imported mesh. A mesh without any normals gets generated ones
+// (smoothed up to DEFAULT_SMOOTH_ANGLE); otherwise only the bad vertices are filled in with the area weighted
+// normal of the faces using them, so the valid normals are kept as they are.
+int fixnormals(mesh* m, char* filename) {
+    vertex_soa v;
+    soa_from_mesh(*m, &v);
+    uint8_t* bad = malloc(max(v.capacity, 4));
+    int n_used;
+    int n_bad = findbadnormals(*m, &v, bad, &n_used);
+    int err = 0;
+
+    if (n_bad > 0 && n_bad == n_used) {
+        printf("\"%s\" has no valid normals, generating them.\n", filename);
+        err = gennormals(m, &v, DEFAULT_SMOOTH_ANGLE);
+    } else if (n_bad > 0) {
+        // Bad normals are reset, then the normals of their faces (twice the face area long) are added up
+        for (int i = 0; i < v.n_vertices; ++i) {
+            if (bad[i]) v.norm[0][i] = v.norm[1][i] = v.norm[2][i] = 0;
+        }
+        for (int t = 0; t < m->n_triangles; ++t) {
+            triangle tri = m->triangles[t];
+            if (tri.a >= v.n_vertices || tri.b >= v.n_vertices || tri.c >= v.n_vertices) continue;
+            if (!bad[tri.a] && !bad[tri.b] && !bad[tri.c]) continue;
+
+            float e1[3], e2[3];
+            for (int i = 0; i < 3; ++i) {
+                e1[i] = v.pos[i][tri.b] - v.pos[i][tri.a];
+                e2[i] = v.pos[i][tri.c] - v.pos[i][tri.a];
+            }
+            float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+            for (int c = 0; c < 3; ++c) {
+                if (!bad[tri.i[c]]) continue;
+                for (int i = 0; i < 3; ++i) v.norm[i][tri.i[c]] += n[i];
+            }
+        }
+
+        int n_left = 0;
+        for (int i = 0; i < v.n_vertices; ++i) {
+            if (!bad[i]) continue;
+            float len = sqrtf(v.norm[0][i] * v.norm[0][i] + v.norm[1][i] * v.norm[1][i] + v.norm[2][i] * v.norm[2][i]);
+            bool ok = len > 0 && len < INFINITY;
+            for (int a = 0; a < 3; ++a) v.norm[a][i] = ok ? v.norm[a][i] / len : 0;
+            n_left += !ok;
+        }
+        printf("WARNING: %d vertices of \"%s\" have missing or invalid normals, filled in from their faces.\n", n_bad, filename);
+        if (n_left) printf("WARNING: %d of them only have degenerate faces and keep a zero normal.\n", n_left);
+    }
+
+    if (!err && n_bad > 0) soa_to_mesh(&v, m);
+    free(bad);
+    soa_free(&v);
+    return err;
+}
+
+// Triangle as sorted-rotation key of vertex indices (winding is kept), for comparing triangle sets
+uint64_t trianglekey(int a, int b, int c) {
+    int v[3] = { a, b, c };
+    int first = (v[1] < v[0]) ? ((v[2] < v[1]) ? 2 : 1) : ((v[2] < v[0]) ? 2 : 0);
+    return ((uint64_t)(uint32_t)v[first] << 42) | ((uint64_t)(uint32_t)v[(first + 1) % 3] << 21) | (uint64_t)(uint32_t)v[(first + 2) % 3];
+}
+
+int cmp_u64(const void* a, const void* b) {
+    uint64_t x = *(uint64_t*)a, y = *(uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+typedef struct keyed_triangle {
+    uint64_t key;
+    int t;
+} keyed_triangle;
+
+int cmp_keyed_triangle(const void* a, const void* b) {
+    keyed_triangle* x = (keyed_triangle*)a;
+    keyed_triangle* y = (keyed_triangle*)b;
+    if (x->key != y->key) return (x->key > y->key) - (x->key < y->key);
+    return x->t - y->t;
+}
+
+// Removes degenerate (zero-area), duplicate and invalid triangles from every submesh, merges identical vertices
+// and drops vertices no triangle references. Triangles are compacted in submesh order and vertices keep their order.
+int cleanmesh(mesh* m, vertex_soa* v) {
+    ownmesh(m);
+    int n_vertices = v->n_vertices, n_triangles = m->n_triangles;
+
+    // Step 1: Identical vertices (all attributes bitwise equal) are merged into the first of them
+    uint32_t tablesize = 1;
+    while (tablesize < (uint32_t)v->n_vertices * 2) tablesize <<= 1;
+    int* table = malloc(tablesize * sizeof(int));
+    memset(table, 0xFF, tablesize * sizeof(int));
+    int* canon = malloc(max(v->n_vertices, 1) * sizeof(int));
+    int merged = 0;
+
+    // Hashes are accumulated one attribute array at a time, which streams through memory and vectorizes
+    uint32_t* hashes = malloc(max(v->n_vertices, 1) * sizeof(uint32_t));
+    uint32_t* arrays[SOA_ARRAYS] = { (uint32_t*)v->pos[0], (uint32_t*)v->pos[1], (uint32_t*)v->pos[2],
+        (uint32_t*)v->norm[0], (uint32_t*)v->norm[1], (uint32_t*)v->norm[2], v->col };
+    for (int i = 0; i < v->n_vertices; ++i) hashes[i] = 0x811c9dc5u;
+    for (int a = 0; a < SOA_ARRAYS; ++a) {
+        uint32_t* words = arrays[a];
+        for (int i = 0; i < v->n_vertices; ++i) hashes[i] = (hashes[i] ^ words[i]) * 0x01000193u;
+    }
+
+    for (int i = 0; i < v->n_vertices; ++i) {
+        uint32_t h = hashes[i] ^ (hashes[i] >> 15);
+        uint32_t slot = h & (tablesize - 1);
+        for (; table[slot] >= 0; slot = (slot + 1) & (tablesize - 1)) {
+            int o = table[slot];
+            if (hashes[o] != hashes[i]) continue;
+            int a = 0;
+            while (a < SOA_ARRAYS && arrays[a][o] == arrays[a][i]) a++;
+            if (a == SOA_ARRAYS) break;
+        }
+        if (table[slot] < 0) table[slot] = i;
+        canon[i] = table[slot];
+        merged += canon[i] != i;
+    }
+    free(table);
+    free(hashes);
+
+    // Step 2: Faces, rebuilt submesh by submesh (faces of overlapping submeshes are written once per submesh)
+    size_t capacity = m->n_triangles;
+    for (int s = 0; s < m->n_submeshes; ++s) {
+        int first = min(m->submeshes[s].start_index / 3, m->n_triangles);
+        capacity += min(first + m->submeshes[s].vertex_count / 3, m->n_triangles) - first;
+    }
+    triangle* triangles = malloc(max(capacity, 1) * sizeof(triangle));
+    keyed_triangle* keys = malloc(max(m->n_triangles, 1) * sizeof(keyed_triangle));
+    bool* removed = calloc(max(m->n_triangles, 1), sizeof(bool));
+    bool* covered = calloc(max(m->n_triangles, 1), sizeof(bool));
+    int n_kept = 0, degenerate = 0, duplicate = 0, invalid = 0, uncovered = 0;
+
+    for (int s = 0; s < m->n_submeshes; ++s) {
+        submesh* sm = &m->submeshes[s];
+        int first = min(sm->start_index / 3, m->n_triangles);
+        int end = min(first + sm->vertex_count / 3, m->n_triangles);
+        int n_keys = 0;
+
+        for (int t = first; t < end; ++t) {
+            covered[t] = true;
+            triangle tri = m->triangles[t];
+            if (tri.a >= v->n_vertices || tri.b >= v->n_vertices || tri.c >= v->n_vertices) {
+                removed[t] = true;
+                invalid++;
+                continue;
+            }
+            for (int c = 0; c < 3; ++c) tri.i[c] = canon[tri.i[c]];
+            m->triangles[t] = tri;
+
+            // Zero area: the edges from the first corner are parallel (or of zero length)
+            float e1[3], e2[3], n[3];
+            for (int i = 0; i < 3; ++i) {
+                e1[i] = v->pos[i][tri.b] - v->pos[i][tri.a];
+                e2[i] = v->pos[i][tri.c] - v->pos[i][tri.a];
+            }
+            n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+            n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+            n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+            float area2 = n[0] * n[0] + n[1] * n[1] + n[2] * n[2];
+            float edges2 = (e1[0] * e1[0] + e1[1] * e1[1] + e1[2] * e1[2]) * (e2[0] * e2[0] + e2[1] * e2[1] + e2[2] * e2[2]);
+            if (tri.a == tri.b || tri.b == tri.c || tri.a == tri.c || !(area2 > 1e-12f * edges2)) {
+                removed[t] = true;
+                degenerate++;
+                continue;
+            }
+
+            keys[n_keys++] = (keyed_triangle){ .key = trianglekey(tri.a, tri.b, tri.c), .t = t };
+        }
+
+        // Only the first of a set of identical faces (same vertices and winding) is kept
+        qsort(keys, n_keys, sizeof(keyed_triangle), cmp_keyed_triangle);
+        for (int k = 1; k < n_keys; ++k) {
+            if (keys[k].key == keys[k - 1].key) {
+                removed[keys[k].t] = true;
+                duplicate++;
+            }
+        }
+
+        sm->start_index = n_kept * 3;
+        for (int t = first; t < end; ++t) {
+            if (!removed[t]) triangles[n_kept++] = m->triangles[t];
+        }
+        sm->vertex_count = n_kept * 3 - sm->start_index;
+    }
+
+    // Faces outside of every submesh are never drawn, but they are kept (after the submeshes) rather than dropped
+    for (int t = 0; t < m->n_triangles; ++t) {
+        if (covered[t]) continue;
+        triangle tri = m->triangles[t];
+        if (tri.a >= v->n_vertices || tri.b >= v->n_vertices || tri.c >= v->n_vertices) {
+            invalid++;
+            continue;
+        }
+        for (int c = 0; c < 3; ++c) tri.i[c] = canon[tri.i[c]];
+        triangles[n_kept++] = tri;
+        uncovered++;
+    }
+    free(keys);
+    free(removed);
+    free(covered);
+    free(canon);
+    free(m->triangles);
+    m->triangles = triangles;
+    m->n_triangles = n_kept;
+
+    // Step 3: Unreferenced vertices
+    int* remap = malloc(max(v->n_vertices, 1) * sizeof(int));
+    memset(remap, 0xFF, max(v->n_vertices, 1) * sizeof(int));
+    for (int t = 0; t < m->n_triangles; ++t) {
+        for (int c = 0; c < 3; ++c) remap[m->triangles[t].i[c]] = 0;
+    }
+    int n_used = 0;
+    for (int i = 0; i < v->n_vertices; ++i) {
+        if (remap[i] < 0) continue;
+        remap[i] = n_used;
+        soa_copy(v, n_used++, i);
+    }
+    for (int t = 0; t < m->n_triangles; ++t) {
+        for (int c = 0; c < 3; ++c) m->triangles[t].i[c] = remap[m->triangles[t].i[c]];
+    }
+    free(remap);
+    v->n_vertices = n_used;
+
+    printf("Cleanup removed %d degenerate, %d duplicate and %d invalid faces (%d -> %d faces, %d outside of any submesh), ",
+        degenerate, duplicate, invalid, n_triangles, m->n_triangles, uncovered);
+    printf("merged %d identical vertices and removed %d unused ones (%d -> %d vertices).\n", merged, n_vertices - merged - v->n_vertices, n_vertices, v->n_vertices);
+    return 0;
+}
+
+#define MAX_OPERATIONS 16
+
+// A processing operation given on the command line (option character and argument)
+typedef struct operation {
+    int opt;
+    char* arg;
+} operation;
+
+// Everything needed to convert one input file, collected from the command line before anything is run
+typedef struct conversion {
+    char* input_filename;
+    int input_mode;
+    bool hasselection;
+    submesh_selector selection;
+
+    operation operations[MAX_OPERATIONS];
+    int n_operations;
+
+    int output_modes[MAX_OUTPUTS];
+    int n_output_modes;
+    char* output_filenames[MAX_OUTPUTS];
+    int n_output_filenames;
+    bool cout; // Outputs go to STDOUT (-C was given before the conversion was complete)
+
+    mesh m;
+    int err;
+} conversion;
+
+// Returns true (and reports it) if two outputs of `c` resolve to the same path, `exportmulti` writes them concurrently
+// Multi-file outputs are directories, so they only collide with other multi-file outputs
+bool duplicate_outputs(conversion* c) {
+    char* paths[MAX_OUTPUTS];
+    char* namebase = c->n_output_filenames > 0 ? c->output_filenames[0] : c->input_filename;
+    bool duplicate = false;
+
+    for (int i = 0; i < c->n_output_modes; ++i) {
+        int mode = c->output_modes[i];
+        if (i < c->n_output_filenames) {
+            paths[i] = strcpy(malloc(strlen(c->output_filenames[i]) + 1), c->output_filenames[i]);
+        } else {
+            paths[i] = chgfname(namebase, mode);
+        }
+
+        bool multi = mode == OUTPUT_MULTI_PLY || mode == OUTPUT_MULTI_OBJ || mode == OUTPUT_MULTI_STORMWORKS;
+        for (int j = 0; j < i && !duplicate && mode != OUTPUT_NONE; ++j) {
+            int other = c->output_modes[j];
+            bool othermulti = other == OUTPUT_MULTI_PLY || other == OUTPUT_MULTI_OBJ || other == OUTPUT_MULTI_STORMWORKS;
+            if (other != OUTPUT_NONE && multi == othermulti && !strcasecmp(paths[i], paths[j])) {
+                printf("Error, two outputs of \"%s\" would be written to \"%s\"\n", c->input_filename, paths[i]);
+                duplicate = true;
+            }
+        }
+    }
+
+    for (int i = 0; i < c->n_output_modes; ++i) free(paths[i]);
+    return duplicate;
+}
+
+// Step 2: Process the mesh (operations are applied in the order they were given)
+int processfile(conversion* c) {
+    int err = 0;
+
+    // Operations work on a structure-of-arrays copy of the vertices, which is converted back once they are done
+    vertex_soa v;
+    soa_from_mesh(c->m, &v);
+
+    bool moved = false; // Positions or submesh ranges changed, so the bounds need recalculating
+    for (int i = 0; i < c->n_operations && !err; ++i) {
+        operation op = c->operations[i];
+        switch (op.opt) {
+            case 'A':
+                err = swapaxes(&v, op.arg);
+                moved = true;
+                break;
+
+            case 'N':
+                err = gennormals(&c->m, &v, (float)atof(op.arg));
+                break;
+
+            case 'c':
+                err = cleanmesh(&c->m, &v);
+                moved = true;
+                break;
+        }
+    }
+
+    if (!err && moved) soa_submesh_bounds(&c->m, &v);
+    if (!err && c->n_operations > 0) soa_to_mesh(&v, &c->m);
+    soa_free(&v);
+    return err;
+}
+
+// Bounded single-producer single-consumer queue between two pipeline stages
+#define STAGE_QUEUE_LEN 2
+
+typedef struct stage_queue {
+    conversion* items[STAGE_QUEUE_LEN];
+    int head, tail;
+    HANDLE slots, filled;
+} stage_queue;
+
+void queue_init(stage_queue* q) {
+    q->head = q->tail = 0;
+    q->slots = CreateSemaphore(NULL, STAGE_QUEUE_LEN, STAGE_QUEUE_LEN, NULL);
+    q->filled = CreateSemaphore(NULL, 0, STAGE_QUEUE_LEN, NULL);
+}
+
+void queue_free(stage_queue* q) {
+    CloseHandle(q->slots);
+    CloseHandle(q->filled);
+}
+
+// Blocks while the queue is full, NULL marks the end of the stream
+void queue_push(stage_queue* q, conversion* c) {
+    WaitForSingleObject(q->slots, INFINITE);
+    q->items[q->tail] = c;
+    q->tail = (q->tail + 1) % STAGE_QUEUE_LEN;
+    ReleaseSemaphore(q->filled, 1, NULL);
+}
+
+conversion* queue_pop(stage_queue* q) {
+    WaitForSingleObject(q->filled, INFINITE);
+    conversion* c = q->items[q->head];
+    q->head = (q->head + 1) % STAGE_QUEUE_LEN;
+    ReleaseSemaphore(q->slots, 1, NULL);
+    return c;
+}
+
+typedef struct pipeline {
+    conversion* conversions;
+    int n_conversions;
+    stage_queue imported, processed;
+    volatile LONG failed; // Error of the first failed conversion
+    volatile LONG failed_at; // Index of the first failed conversion, later ones are skipped
+} pipeline;
+
+void pipeline_fail(pipeline* p, conversion* c) {
+    LONG idx = c - p->conversions, prev;
+    while ((prev = p->failed_at) > idx) {
+        if (InterlockedCompareExchange(&p->failed_at, idx, prev) == prev) {
+            p->failed = c->err;
+            break;
+        }
+    }
+}
+
+bool pipeline_skip(pipeline* p, conversion* c) {
+    return c->err || (c - p->conversions) > p->failed_at;
+}
+
+DWORD WINAPI pipeline_import(LPVOID param) {
+    pipeline* p = param;
+    for (int i = 0; i < p->n_conversions && i <= p->failed_at; ++i) {
+        conversion* c = &p->conversions[i];
+        c->err = importfile(c->input_filename, c->input_mode, c->hasselection ? &c->selection : NULL, &c->m);
+        if (c->err) pipeline_fail(p, c);
+        queue_push(&p->imported, c);
+    }
+    queue_push(&p->imported, NULL);
+    return 0;
+}
+
+DWORD WINAPI pipeline_export(LPVOID param) {
+    pipeline* p = param;
+    conversion* c;
+    while ((c = queue_pop(&p->processed)) != NULL) {
+        if (!pipeline_skip(p, c)) {
+            c->err = exportmulti(c->input_filename, c->output_filenames, c->n_output_filenames, c->m, c->output_modes, c->n_output_modes, c->cout);
+            if (c->err) pipeline_fail(p, c);
+        }
+        freemesh(&c->m);
+    }
+    return 0;
+}
+
+// Runs all conversions with reading, processing and writing overlapped:
+// while file N is processed, file N+1 is already being imported and file N-1 is being exported
+int runpipeline(conversion* conversions, int n_conversions) {
+    pipeline p = { .conversions = conversions, .n_conversions = n_conversions, .failed = 0, .failed_at = n_conversions };
+    queue_init(&p.imported);
+    queue_init(&p.processed);
+
+    HANDLE importer = CreateThread(NULL, 0, pipeline_import, &p, 0, NULL);
+    HANDLE exporter = CreateThread(NULL, 0, pipeline_export, &p, 0, NULL);
+
+    conversion* c;
+    while ((c = queue_pop(&p.imported)) != NULL) {
+        if (!pipeline_skip(&p, c)) {
+            c->err = processfile(c);
+            if (c->err) pipeline_fail(&p, c);
+        }
+        queue_push(&p.processed, c);
+    }
+    queue_push(&p.processed, NULL);
+
+    HANDLE threads[2] = { importer, exporter };
+    WaitForMultipleObjects(2, threads, TRUE, INFINITE);
+    CloseHandle(importer);
+    CloseHandle(exporter);
+    queue_free(&p.imported);
+    queue_free(&p.processed);
+
+    return p.failed;
+}
+
+// Runs all conversions one after the other, stopping at the first error
+int runsequential(conversion* conversions, int n_conversions) {
+    for (int i = 0; i < n_conversions; ++i) {
+        conversion* c = &conversions[i];
+        c->err = importfile(c->input_filename, c->input_mode, c->hasselection ? &c->selection : NULL, &c->m);
+        if (!c->err) c->err = processfile(c);
+        if (!c->err) c->err = exportmulti(c->input_filename, c->output_filenames, c->n_output_filenames, c->m, c->output_modes, c->n_output_modes, c->cout);
+        freemesh(&c->m);
+        if (c->err) return c->err;
+    }
+    return 0;
+}
+
+// Returns true if `filename` ends with `ext` (case-insensitive)
+bool hasext(const char* filename, const char* ext) {
+    size_t n = strlen(filename), e = strlen(ext);
+    return n >= e && !strcasecmp(&filename[n - e], ext);
+}
+
+// Appends the paths of all files in `dir` (and its subdirectories) ending with `ext` to `*files`
+void listfiles(char* dir, const char* ext, char*** files, int* n_files) {
+    DIR* d = opendir(dir);
+    if (d == NULL) return;
+
+    struct dirent* entry;
+    while ((entry = readdir(d)) != NULL) {
+        if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")) continue;
+
+        char* path = malloc(strlen(dir) + strlen(entry->d_name) + 2);
+        sprintf(path, "%s/%s", dir, entry->d_name);
+
+        struct stat st;
+        if (stat(path, &st)) {
+            free(path);
+        } else if (S_ISDIR(st.st_mode)) {
+            listfiles(path, ext, files, n_files);
+            free(path);
+        } else if (hasext(path, ext)) {
+            *files = realloc(*files, (*n_files + 1) * sizeof(char*));
+            (*files)[(*n_files)++] = path;
+        } else {
+            free(path);
+        }
+    }
+
+    closedir(d);
+}
+
+uint64_t mixhash(uint64_t h) {
+    // splitmix64 finalizer
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return h;
+}
+
+uint64_t floathash(uint64_t h, float f) {
+    if (f == 0.0f) f = 0.0f; // -0 and +0 are the same geometry
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return mixhash(h ^ bits);
+}
+
+// Canonical geometry hash of submesh #`s` of `m`, given the hash of every vertex
+// Triangles are hashed starting from their smallest vertex hash (so the winding is kept but the starting corner
+// is not), and combined with a commutative sum, so the hash depends neither on the order of the triangles
+// nor on the order or duplication of the vertices. Submesh IDs are not included.
+uint64_t submeshhash(mesh m, int s, uint64_t* vertex_hashes) {
+    submesh sm = m.submeshes[s];
+    uint64_t sum = 0;
+
+    for (int t = sm.start_index / 3; t < (sm.start_index + sm.vertex_count) / 3; ++t) {
+        uint64_t v[3] = { vertex_hashes[m.triangles[t].a], vertex_hashes[m.triangles[t].b], vertex_hashes[m.triangles[t].c] };
+        int first = (v[1] < v[0]) ? ((v[2] < v[1]) ? 2 : 1) : ((v[2] < v[0]) ? 2 : 0);
+
+        uint64_t h = 0x9e3779b97f4a7c15ULL;
+        for (int c = 0; c < 3; ++c) h = mixhash(h ^ v[(first + c) % 3]);
+        sum += h;
+    }
+
+    return mixhash(sum ^ mixhash(((uint64_t)sm.vertex_count << 16) | sm.shadertype));
+}
+
+// Canonical geometry hashes of `m` and of each of its submeshes (`submesh_hashes` holds `m.n_submeshes` values)
+// The mesh hash combines the submesh hashes commutatively, so submesh order does not matter either
+uint64_t meshhash(mesh m, uint64_t* submesh_hashes) {
+    uint64_t* vertex_hashes = malloc(max(m.n_vertices, 1) * sizeof(uint64_t));
+    for (int v = 0; v < m.n_vertices; ++v) {
+        vertex vtx = m.vertices[v];
+        uint64_t h = 0;
+        for (int a = 0; a < 3; ++a) h = floathash(h, vtx.pos[a]);
+        for (int a = 0; a < 3; ++a) h = floathash(h, vtx.norm[a]);
+        vertex_hashes[v] = mixhash(h ^ ((uint64_t)vtx.r | vtx.g << 8 | vtx.b << 16 | (uint64_t)vtx.a << 24));
+    }
+
+    uint64_t sum = 0;
+    for (int s = 0; s < m.n_submeshes; ++s) {
+        submesh_hashes[s] = submeshhash(m, s, vertex_hashes);
+        sum += mixhash(submesh_hashes[s]);
+    }
+
+    free(vertex_hashes);
+    return mixhash(sum ^ m.n_submeshes);
+}
+
+// A mesh file of a scanned library
+typedef struct library_entry {
+    char* path;
+    int err;
+    uint64_t hash;
+    int n_submeshes;
+    uint64_t* submesh_hashes;
+    char** submesh_ids;
+} library_entry;
+
+typedef struct library {
+    library_entry* entries;
+    int n_entries;
+    int input_mode;
+    int* output_modes;
+    int n_output_modes;
+    int* representatives; // Index of the first entry with the same hash, for every entry
+} library;
+
+void library_hash(void* param, int i) {
+    library* lib = param;
+    library_entry* e = &lib->entries[i];
+
+    mesh m = { 0 };
+    e->err = importfile(e->path, lib->input_mode, NULL, &m);
+    if (!e->err) {
+        e->n_submeshes = m.n_submeshes;
+        e->submesh_hashes = malloc(max(m.n_submeshes, 1) * sizeof(uint64_t));
+        e->submesh_ids = malloc(max(m.n_submeshes, 1) * sizeof(char*));
+        for (int s = 0; s < m.n_submeshes; ++s) e->submesh_ids[s] = copysubmesh(m.submeshes[s]).id;
+        e->hash = meshhash(m, e->submesh_hashes);
+    }
+    freemesh(&m);
+}
+
+void library_convert(void* param, int i) {
+    library* lib = param;
+    library_entry* e = &lib->entries[i];
+    if (e->err || lib->representatives[i] != i) return;
+
+    mesh m = { 0 };
+    e->err = importfile(e->path, lib->input_mode, NULL, &m);
+    if (!e->err) e->err = exportmulti(e->path, NULL, 0, m, lib->output_modes, lib->n_output_modes, false);
+    freemesh(&m);
+}
+
+// Returns true if `a` and `b` hold exactly the same data, so converting them produces the same files
+bool samemesh(mesh a, mesh b) {
+    if (a.n_vertices != b.n_vertices || a.n_triangles != b.n_triangles || a.n_submeshes != b.n_submeshes) return false;
+    if (memcmp(a.vertices, b.vertices, a.n_vertices * sizeof(vertex))) return false;
+    if (memcmp(a.triangles, b.triangles, a.n_triangles * sizeof(triangle))) return false;
+
+    for (int s = 0; s < a.n_submeshes; ++s) {
+        submesh x = a.submeshes[s], y = b.submeshes[s];
+        if (x.start_index != y.start_index || x.vertex_count != y.vertex_count || x.shadertype != y.shadertype) return false;
+        if (memcmp(x.cullmin, y.cullmin, sizeof(x.cullmin)) || memcmp(x.cullmax, y.cullmax, sizeof(x.cullmax))) return false;
+        if (strcmp(x.id, y.id)) return false;
+    }
+    return true;
+}
+
+// Links (or copies, if hard links are not possible) the outputs of `src` to those of the duplicate `dup`
+// The hashes only say the geometry matches, so outputs are linked only if both files hold exactly the same
+// data (including submesh IDs and order). Otherwise, and for directory outputs (multi-file modes, which
+// cannot be linked), the duplicate is converted instead.
+int library_link(library* lib, library_entry* src, library_entry* dup) {
+    mesh m = { 0 };
+    int err = importfile(dup->path, lib->input_mode, NULL, &m);
+    if (err) return err;
+
+    // Submesh IDs and order are known from hashing, the full comparison is only done when they match
+    bool identical = src->n_submeshes == dup->n_submeshes;
+    for (int s = 0; s < dup->n_submeshes && identical; ++s) {
+        identical = src->submesh_hashes[s] == dup->submesh_hashes[s] && !strcmp(src->submesh_ids[s], dup->submesh_ids[s]);
+    }
+    if (identical) {
+        mesh srcm = { 0 };
+        identical = !importfile(src->path, lib->input_mode, NULL, &srcm) && samemesh(srcm, m);
+        freemesh(&srcm);
+    }
+    if (!identical) printf("\"%s\" differs from \"%s\" beyond its geometry, converting it\n", dup->path, src->path);
+
+    for (int o = 0; o < lib->n_output_modes && !err; ++o) {
+        int mode = lib->output_modes[o];
+        if (mode == OUTPUT_NONE) continue;
+
+        if (!identical || mode == OUTPUT_MULTI_PLY || mode == OUTPUT_MULTI_OBJ || mode == OUTPUT_MULTI_STORMWORKS) {
+            err = exportfile(dup->path, NULL, m, mode, false);
+            continue;
+        }
+
+        char* srcname = chgfname(src->path, mode);
+        char* dstname = chgfname(dup->path, mode);
+        remove(dstname);
+        if (!CreateHardLink(dstname, srcname, NULL) && !CopyFile(srcname, dstname, FALSE)) {
+            printf("Error linking \"%s\" to \"%s\"\n", dstname, srcname);
+            err = 2;
+        }
+        free(srcname);
+        free(dstname);
+    }
+
+    freemesh(&m);
+    return err;
+}
+
+uint64_t* sort_hashes; // Hashes being sorted by `cmp_hash_index`
+
+int cmp_hash_index(const void* a, const void* b) {
+    uint64_t ha = sort_hashes[*(int*)a], hb = sort_hashes[*(int*)b];
+    if (ha != hb) return ha < hb ? -1 : 1;
+    return *(int*)a - *(int*)b;
+}
+
+// Scans `dir` recursively for meshes of `input_mode`, hashes their geometry in parallel and reports
+// groups of duplicate meshes and submeshes. If `link` is set, every unique mesh is converted once to
+// the output modes and the outputs of its duplicates are hard-linked (or copied) from it.
+int dedupelibrary(char* dir, int input_mode, bool link, int* output_modes, int n_output_modes) {
+    char** files = NULL;
+    int n_files = 0;
+    listfiles(dir, IN_EXTS[input_mode], &files, &n_files);
+    printf("Scanning %d %s files in \"%s\"\n", n_files, IN_EXTS[input_mode], dir);
+
+    library lib = {
+        .entries = calloc(max(n_files, 1), sizeof(library_entry)),
+        .n_entries = n_files,
+        .input_mode = input_mode,
+        .output_modes = output_modes,
+        .n_output_modes = n_output_modes,
+        .representatives = malloc(max(n_files, 1) * sizeof(int))
+    };
+    for (int i = 0; i < n_files; ++i) lib.entries[i].path = files[i];
+
+    parallel_for(n_files, library_hash, &lib);
+
+    // Group meshes by hash (failed imports are left out)
+    int* order = malloc(max(n_files, 1) * sizeof(int));
+    uint64_t* hashes = malloc(max(n_files, 1) * sizeof(uint64_t));
+    int n_ok = 0;
+    for (int i = 0; i < n_files; ++i) {
+        lib.representatives[i] = i;
+        hashes[i] = lib.entries[i].hash;
+        if (!lib.entries[i].err) order[n_ok++] = i;
+    }
+    sort_hashes = hashes;
+    qsort(order, n_ok, sizeof(int), cmp_hash_index);
+
+    int n_unique = 0, n_groups = 0;
+    printf("\n--BEGIN DUPLICATE MESHES--\n");
+    for (int g = 0; g < n_ok;) {
+        int end = g + 1;
+        while (end < n_ok && hashes[order[end]] == hashes[order[g]]) end++;
+
+        n_unique++;
+        if (end - g > 1) {
+            n_groups++;
+            printf("%016llx: %d meshes\n", (unsigned long long)hashes[order[g]], end - g);
+            for (int k = g; k < end; ++k) {
+                printf("\t%s\n", lib.entries[order[k]].path);
+                lib.representatives[order[k]] = order[g];
+            }
+        }
+        g = end;
+    }
+    printf("--END DUPLICATE MESHES--\n");
+
+    // Same for submeshes, across all meshes
+    int n_submeshes = 0;
+    for (int i = 0; i < n_files; ++i) n_submeshes += lib.entries[i].err ? 0 : lib.entries[i].n_submeshes;
+    int* sm_entry = malloc(max(n_submeshes, 1) * sizeof(int));
+    int* sm_index = malloc(max(n_submeshes, 1) * sizeof(int));
+    uint64_t* sm_hashes = malloc(max(n_submeshes, 1) * sizeof(uint64_t));
+    int* sm_order = malloc(max(n_submeshes, 1) * sizeof(int));
+    int n = 0;
+    for (int i = 0; i < n_files; ++i) {
+        if (lib.entries[i].err) continue;
+        for (int s = 0; s < lib.entries[i].n_submeshes; ++s, ++n) {
+            sm_entry[n] = i;
+            sm_index[n] = s;
+            sm_hashes[n] = lib.entries[i].submesh_hashes[s];
+            sm_order[n] = n;
+        }
+    }
+    sort_hashes = sm_hashes;
+    qsort(sm_order, n_submeshes, sizeof(int), cmp_hash_index);
+
+    int n_sm_groups = 0;
+    printf("--BEGIN DUPLICATE SUBMESHES--\n");
+    for (int g = 0; g < n_submeshes;) {
+        int end = g + 1;
+        while (end < n_submeshes && sm_hashes[sm_order[end]] == sm_hashes[sm_order[g]]) end++;
+
+        if (end - g > 1) {
+            n_sm_groups++;
+            printf("%016llx: %d submeshes\n", (unsigned long long)sm_hashes[sm_order[g]], end - g);
+            for (int k = g; k < end; ++k) {
+                library_entry* e = &lib.entries[sm_entry[sm_order[k]]];
+                printf("\t%s: \"%s\"\n", e->path, e->submesh_ids[sm_index[sm_order[k]]]);
+            }
+        }
+        g = end;
+    }
+    printf("--END DUPLICATE SUBMESHES--\n\n");
+
+    printf("%d meshes (%d failed to import), %d unique, %d duplicate groups, %d duplicate submesh groups\n",
+        n_files, n_files - n_ok, n_unique, n_groups, n_sm_groups);
+
+    int err = 0;
+    if (link) {
+        // Each unique mesh is converted once, then its outputs are reused for the duplicates
+        parallel_for(n_files, library_convert, &lib);
+
+        for (int i = 0; i < n_files && !err; ++i) {
+            library_entry* e = &lib.entries[i];
+            if (e->err) continue;
+            if (lib.representatives[i] != i) err = library_link(&lib, &lib.entries[lib.representatives[i]], e);
+        }
+    }
+
+    for (int i = 0; i < n_files; ++i) {
+        library_entry* e = &lib.entries[i];
+        if (!e->err) {
+            for (int s = 0; s < e->n_submeshes; ++s) free(e->submesh_ids[s]);
+        }
+        free(e->submesh_ids);
+        free(e->submesh_hashes);
+        free(e->path);
+    }
+    free(sm_entry);
+    free(sm_index);
+    free(sm_hashes);
+    free(sm_order);
+    free(order);
+    free(hashes);
+    free(lib.representatives);
+    free(lib.entries);
+    free(files);
+
+    return err;
+}
+
+typedef struct packing {
+    char* dir;
+    char** files;
+    int input_mode;
+    char** names;
+    char** blocks; // Interop-layout block of every mesh (NULL if the import failed)
+    size_t* sizes;
+} packing;
+
+void pack_encode(void* param, int i) {
+    packing* p = param;
+    mesh m = { 0 };
+
+    if (!importfile(p->files[i], p->input_mode, NULL, &m)) {
+        p->sizes[i] = interopsize(m);
+        p->blocks[i] = malloc(p->sizes[i]);
+        encodeinterop(m, p->blocks[i]);
+    }
+    freemesh(&m);
+
+    // Entries are named by their path relative to the packed directory, without the extension
+    char* name = p->files[i] + strlen(p->dir) + 1;
+    p->names[i] = malloc(strlen(name) + 1);
+    strcpy(p->names[i], name);
+    replacechar(p->names[i], '\\', '/');
+    p->names[i][strlen(p->names[i]) - strlen(IN_EXTS[p->input_mode])] = '\0';
+}
+
+pack_entry* sort_entries; // Index being sorted by `cmp_pack_entry`
+char** sort_names;
+
+int cmp_pack_entry(const void* a, const void* b) {
+    pack_entry* ea = &sort_entries[*(int*)a];
+    pack_entry* eb = &sort_entries[*(int*)b];
+    if (ea->name_hash != eb->name_hash) return ea->name_hash < eb->name_hash ? -1 : 1;
+    return strcmp(sort_names[*(int*)a], sort_names[*(int*)b]);
+}
+
+// Packs every file of `input_mode` in `dir` (recursively) into the mesh pack `<dir>.swpack`
+// Files are imported and encoded in parallel
+int packdirectory(char* dir, int input_mode) {
+    int err = 0;
+    packing p = { .dir = dir, .input_mode = input_mode };
+
+    // Trailing separators would end up in the pack and entry names
+    while (strlen(dir) > 1 && (dir[strlen(dir) - 1] == '/' || dir[strlen(dir) - 1] == '\\')) dir[strlen(dir) - 1] = '\0';
+
+    int n_files = 0;
+    listfiles(dir, IN_EXTS[input_mode], &p.files, &n_files);
+    p.names = calloc(max(n_files, 1), sizeof(char*));
+    p.blocks = calloc(max(n_files, 1), sizeof(char*));
+    p.sizes = calloc(max(n_files, 1), sizeof(size_t));
+
+    parallel_for(n_files, pack_encode, &p);
+
+    // Build the index
+    pack_entry* entries = calloc(max(n_files, 1), sizeof(pack_entry));
+    int* order = malloc(max(n_files, 1) * sizeof(int));
+    int n_entries = 0;
+    size_t names_size = 0;
+    for (int i = 0; i < n_files; ++i) {
+        if (p.blocks[i] == NULL) continue;
+        entries[i].name_hash = namehash(p.names[i], strlen(p.names[i]));
+        entries[i].name_length = strlen(p.names[i]);
+        names_size += entries[i].name_length + 1;
+        order[n_entries++] = i;
+    }
+    sort_entries = entries;
+    sort_names = p.names;
+    qsort(order, n_entries, sizeof(int), cmp_pack_entry);
+
+    pack_header h = {
+        .version = 1,
+        .n_entries = n_entries,
+        .index_offset = sizeof(pack_header),
+        .names_offset = sizeof(pack_header) + n_entries * sizeof(pack_entry)
+    };
+    memcpy(h.magic, PACK_SIGNATURE, 4);
+
+    uint64_t cursor = h.names_offset;
+    for (int k = 0; k < n_entries; ++k) {
+        entries[order[k]].name_offset = cursor;
+        cursor += entries[order[k]].name_length + 1;
+    }
+    for (int k = 0; k < n_entries; ++k) {
+        cursor = INTEROP_ALIGN(cursor);
+        entries[order[k]].offset = cursor;
+        entries[order[k]].size = p.sizes[order[k]];
+        cursor += p.sizes[order[k]];
+    }
+
+    char* packname = malloc(strlen(dir) + strlen(IN_EXTS[INPUT_PACK]) + 1);
+    sprintf(packname, "%s%s", dir, IN_EXTS[INPUT_PACK]);
+
+    FILE* packfile = fopen(packname, "wb");
+    if (packfile == NULL) {
+        err = 2;
+    } else {
+        static const char padding[16] = { 0 };
+        uint64_t written = 0;
+
+        fwrite(&h, sizeof(h), 1, packfile);
+        for (int k = 0; k < n_entries; ++k) fwrite(&entries[order[k]], sizeof(pack_entry), 1, packfile);
+        for (int k = 0; k < n_entries; ++k) fwrite(p.names[order[k]], 1, entries[order[k]].name_length + 1, packfile);
+        written = h.names_offset + names_size;
+
+        for (int k = 0; k < n_entries; ++k) {
+            pack_entry e = entries[order[k]];
+            fwrite(padding, 1, e.offset - written, packfile);
+            fwrite(p.blocks[order[k]], 1, e.size, packfile);
+            written = e.offset + e.size;
+        }
+
+        if (ferror(packfile)) err = 4;
+        fclose(packfile);
+        printf("Packed %d of %d %s files from \"%s\" into \"%s\" (%llu bytes)\n",
+            n_entries, n_files, IN_EXTS[input_mode], dir, packname, (unsigned long long)written);
+    }
+
+    if (err) printf("Error #%d writing mesh pack %s\n", err, packname);
+
+    for (int i = 0; i < n_files; ++i) {
+        free(p.files[i]);
+        free(p.names[i]);
+        free(p.blocks[i]);
+    }
+    free(p.files);
+    free(p.names);
+    free(p.blocks);
+    free(p.sizes);
+    free(entries);
+    free(order);
+    free(packname);
+
+    return err;
+}
+
+// Prints the entries of the mesh pack `filename` (read straight from the mapped index and entry headers)
+int listpack(char* filename) {
+    int err = 0;
+    size_t len = 0;
+    char* pack = openpack(filename, &len, false, &err);
+    if (pack == NULL) {
+        printf("Error %d opening mesh pack \"%s\"\n", err, filename);
+        return err;
+    }
+
+    pack_header h;
+    memcpy(&h, pack, sizeof(h));
+    pack_entry* index = (pack_entry*)&pack[h.index_offset];
+
+    printf("%u entries in \"%s\"\n", h.n_entries, filename);
+    printf("--BEGIN PACK ENTRIES--\n");
+    for (uint32_t i = 0; i < h.n_entries; ++i) {
+        pack_entry e = index[i];
+        interop_header mh = { 0 };
+        if (inbounds(e.offset, sizeof(mh), len)) memcpy(&mh, &pack[e.offset], sizeof(mh));
+        if (!inbounds(e.name_offset, e.name_length, len)) e.name_length = 0;
+
+        printf("\"%.*s\", %u vertices, %u triangles, %u submeshes, %llu bytes\n",
+            (int)e.name_length, e.name_length ? &pack[e.name_offset] : "", mh.n_vertices, mh.n_triangles, mh.n_submeshes, (unsigned long long)e.size);
+    }
+    printf("--END PACK ENTRIES--\n");
+
+    unmapfile(pack);
+    return 0;
+}
+
+// Time to wait for further changes before converting, so bursts of writes (e.g. an export in progress) are merged
+#define WATCH_DEBOUNCE_MS 250
+
+typedef struct watched_file {
+    char* path;
+    time_t mtime;
+    off_t size;
+} watched_file;
+
+int cmp_watched_file(const void* a, const void* b) {
+    return strcmp(((watched_file*)a)->path, ((watched_file*)b)->path);
+}
+
+int cmp_string(const void* a, const void* b) {
+    return strcmp(*(char**)a, *(char**)b);
+}
+
+// Converts `path` with the output modes and prints how long it took
+void watch_convert(char* path, int input_mode, int* output_modes, int n_output_modes) {
+    double start = now_ms();
+    mesh m = { 0 };
+
+    int err = importfile(path, input_mode, NULL, &m);
+    if (!err) err = exportmulti(path, NULL, 0, m, output_modes, n_output_modes, false);
+    freemesh(&m);
+
+    if (err) {
+        printf("Error #%d converting \"%s\"\n", err, path);
+    } else {
+        printf("Converted \"%s\" in %.1f ms\n", path, now_ms() - start);
+    }
+}
+
+// Watches `dir` (recursively) and converts every file of `input_mode` that is created or modified,
+// using the already-running process. On startup, files whose first output is missing or older are converted.
+int watchdirectory(char* dir, int input_mode, int* output_modes, int n_output_modes) {
+    HANDLE change = FindFirstChangeNotification(dir, TRUE, FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE);
+    if (change == INVALID_HANDLE_VALUE) {
+        printf("Error, unable to watch directory \"%s\"\n", dir);
+        return 1;
+    }
+
+    // Known files, sorted by path
+    watched_file* known = NULL;
+    int n_known = 0;
+    bool startup = true;
+
+    printf("Watching \"%s\" for %s files (Ctrl+C to stop)\n", dir, IN_EXTS[input_mode]);
+
+    while (true) {
+        char** files = NULL;
+        int n_files = 0;
+        listfiles(dir, IN_EXTS[input_mode], &files, &n_files);
+        qsort(files, n_files, sizeof(char*), cmp_string);
+
+        watched_file* scanned = malloc(max(n_files, 1) * sizeof(watched_file));
+        int n_scanned = 0;
+
+        // Both lists are sorted, so changes are found by walking them together
+        int k = 0;
+        for (int i = 0; i < n_files; ++i) {
+            struct stat st;
+            if (stat(files[i], &st)) {
+                free(files[i]);
+                continue;
+            }
+
+            while (k < n_known && strcmp(known[k].path, files[i]) < 0) k++;
+            bool isknown = k < n_known && !strcmp(known[k].path, files[i]);
+
+            bool modified;
+            if (isknown) {
+                modified = known[k].mtime != st.st_mtime || known[k].size != st.st_size;
+            } else if (startup) {
+                struct stat outst;
+                char* outname = chgfname(files[i], output_modes[0]);
+                modified = output_modes[0] != OUTPUT_NONE && (stat(outname, &outst) || outst.st_mtime < st.st_mtime);
+                free(outname);
+            } else {
+                modified = true;
+            }
+
+            if (modified) {
+                watch_convert(files[i], input_mode, output_modes, n_output_modes);
+
+                // An output written over the input must not be mistaken for a change, but any other change made
+                // during the conversion (e.g. a new export) must still be picked up, so the input is only re-read
+                // if it is one of the outputs
+                bool overwritten = false;
+                for (int o = 0; o < n_output_modes && !overwritten; ++o) {
+                    char* outname = chgfname(files[i], output_modes[o]);
+                    int mode = output_modes[o];
+                    bool file = mode != OUTPUT_NONE && mode != OUTPUT_MULTI_PLY && mode != OUTPUT_MULTI_OBJ && mode != OUTPUT_MULTI_STORMWORKS;
+                    overwritten = file && !strcasecmp(outname, files[i]);
+                    free(outname);
+                }
+                if (overwritten) stat(files[i], &st);
+            }
+
+            scanned[n_scanned++] = (watched_file){ .path = files[i], .mtime = st.st_mtime, .size = st.st_size };
+        }
+
+        for (int i = 0; i < n_known; ++i) free(known[i].path);
+        free(known);
+        free(files);
+        known = scanned;
+        n_known = n_scanned;
+        startup = false;
+
+        // Wait for a change, then for the directory to settle
+        if (WaitForSingleObject(change, INFINITE) != WAIT_OBJECT_0) break;
+        do {
+            FindNextChangeNotification(change);
+        } while (WaitForSingleObject(change, WATCH_DEBOUNCE_MS) == WAIT_OBJECT_0);
+    }
+
+    for (int i = 0; i < n_known; ++i) free(known[i].path);
+    free(known);
+    FindCloseChangeNotification(change);
+    return 1;
+}
+
+// Streaming conversion of PLY/OBJ inputs larger than memory into several .mesh parts
+// Pass 1 spills vertex positions (with colors), normals and triangle corners to temporary files next to the output.
+// Pass 2 reads the vertex files through fixed-size page caches and the corners in chunks, starting a new part
+// whenever the next triangle would go over the 16-bit vertex limit or over the triangles the memory cap allows per part.
+// Everything pass 2 allocates (part buffers, caches, corner chunk) is sized from the memory cap.
+#define STREAM_MIN_MB 8
+#define STREAM_MAX_POLYGON 64
+#define STREAM_CHUNK_CORNERS (3 * 16384)
+#define STREAM_PART_VERTICES UINT16_MAX // The vertex count is stored in 16 bits
+#define STREAM_TABLE_SIZE (1 << 17)
+// Bytes per part triangle: the triangle itself and the worst case of scratch space used while processing it
+// (e.g. generating missing normals)
+#define STREAM_TRIANGLE_COST 96
+#define STREAM_PAGE_SIZE (64 * 1024)
+
+typedef struct stream_position {
+    float pos[3];
+    uint8_t col[4];
+} stream_position;
+
+typedef struct stream_corner {
+    uint32_t v;
+    int32_t vn; // Normal index, -1 if the corner has none
+} stream_corner;
+
+typedef struct stream_spill {
+    FILE* positions;
+    FILE* normals;
+    FILE* corners;
+    uint32_t n_positions, n_normals;
+    uint64_t n_triangles;
+
+    // PLY vertex and polygon being read
+    long vertex_idx;
+    stream_position position;
+    float normal[3];
+    bool hasnormals;
+    stream_corner polygon[STREAM_MAX_POLYGON];
+    int n_polygon;
+    int err;
+} stream_spill;
+
+// Writes the triangles of a polygon (as a fan around its first corner)
+void spill_polygon(stream_spill* s, stream_corner* polygon, int n) {
+    for (int i = 1; i + 1 < n; ++i) {
+        stream_corner tri[3] = { polygon[0], polygon[i], polygon[i + 1] };
+        fwrite(tri, sizeof(tri), 1, s->corners);
+        s->n_triangles++;
+    }
+}
+
+void spill_ply_vertex(stream_spill* s) {
+    fwrite(&s->position, sizeof(stream_position), 1, s->positions);
+    s->n_positions++;
+    if (s->hasnormals) {
+        fwrite(s->normal, sizeof(s->normal), 1, s->normals);
+        s->n_normals++;
+    }
+    memset(&s->position, 0, sizeof(s->position));
+    memset(s->normal, 0, sizeof(s->normal));
+}
+
+static int stream_ply_vertex_cb(p_ply_argument argument) {
+    stream_spill* s;
+    long idx;
+    ply_get_argument_user_data(argument, (void*)&s, &idx);
+
+    // Properties arrive vertex by vertex, so a new index means the previous vertex is complete
+    long vertex_idx;
+    ply_get_argument_element(argument, NULL, &vertex_idx);
+    if (vertex_idx != s->vertex_idx) {
+        if (s->vertex_idx >= 0) spill_ply_vertex(s);
+        s->vertex_idx = vertex_idx;
+    }
+
+    double value = ply_get_argument_value(argument);
+    if (idx < 3) {
+        s->position.pos[idx] = (float)value;
+    } else if (idx < 6) {
+        s->normal[idx - 3] = (float)value;
+    } else {
+        s->position.col[idx - 6] = (uint8_t)value;
+    }
+    return 1;
+}
+
+static int stream_ply_face_cb(p_ply_argument argument) {
+    stream_spill* s;
+    ply_get_argument_user_data(argument, (void*)&s, NULL);
+
+    // The vertices of the last PLY vertex are complete once faces start
+    if (s->vertex_idx >= 0) {
+        spill_ply_vertex(s);
+        s->vertex_idx = -1;
+    }
 
-    // Triangle count (4b) (n_triangles * 3)
-    uint32_t trin = m.n_triangles * 3;
-    fwrite(&trin, 1, sizeof(uint32_t), destfd);
+    long length, value_index;
+    ply_get_argument_property(argument, NULL, &length, &value_index);
+    if (value_index < 0) {
+        if (length > STREAM_MAX_POLYGON) {
+            printf("Error, faces with more than %d vertices are not supported\n", STREAM_MAX_POLYGON);
+            s->err = 3;
+            return 0;
+        }
+        s->n_polygon = 0;
+        return 1;
+    }
 
-    // "Edge buffer" (triangles)
-    fwrite(m.triangles, m.n_triangles, sizeof(triangle), destfd);
+    uint32_t v = (uint32_t)ply_get_argument_value(argument);
+    s->polygon[s->n_polygon++] = (stream_corner){ .v = v, .vn = s->hasnormals ? (int32_t)v : -1 };
+    if (value_index == length - 1) spill_polygon(s, s->polygon, s->n_polygon);
+    return 1;
+}
 
-    // Submesh count
-    uint16_t smct = m.n_submeshes;
-    fwrite(&smct, 1, sizeof(uint16_t), destfd);
+int spillply(char* filename, stream_spill* s) {
+    p_ply ply = ply_open(filename, NULL, 0, NULL);
+    if (!ply) return 1;
+    if (!ply_read_header(ply)) {
+        ply_close(ply);
+        return 2;
+    }
 
-    for (int s = 0; s < m.n_submeshes; ++s) {
-        submesh sm = m.submeshes[s];
+    static const char* properties[] = { "x", "y", "z", "nx", "ny", "nz", "red", "green", "blue", "alpha" };
+    long nvertices = 0;
+    for (int p = 0; p < 10; ++p) {
+        long n = ply_set_read_cb(ply, "vertex", properties[p], stream_ply_vertex_cb, (void*)s, p);
+        if (p == 0) nvertices = n;
+        if (p == 3) s->hasnormals = n > 0;
+    }
+    long ntriangles = ply_set_read_cb(ply, "face", "vertex_indices", stream_ply_face_cb, (void*)s, 0);
+    printf("PLY header parsed: %ld vertices and %ld faces\n", nvertices, ntriangles);
 
-        // Vertices start (4b)
-        fwrite(&sm.start_index, 1, sizeof(uint32_t), destfd);
+    s->vertex_idx = -1;
+    int err = ply_read(ply) ? 0 : (s->err ? s->err : 3);
+    if (s->vertex_idx >= 0) spill_ply_vertex(s); // No faces at all
+    ply_close(ply);
+    return err;
+}
 
-        // Vertices count (4b)
-        // uint32_t vct = sm.vertex_count * 3;
-        fwrite(&sm.vertex_count, 1, sizeof(uint32_t), destfd);
+// Parses an OBJ face corner ("v", "v/vt", "v//vn" or "v/vt/vn"), negative indices count back from the end
+bool parse_obj_corner(char* token, stream_spill* s, stream_corner* corner) {
+    char* end;
+    long v = strtol(token, &end, 10);
+    long vn = 0;
+    if (end == token || v == 0) return false;
+    if (*end == '/') {
+        char* vt = end + 1;
+        strtol(vt, &end, 10); // Texture coordinates are not used
+        if (*end == '/') vn = strtol(end + 1, &end, 10);
+    }
 
-        // Unknown (2b)
-        fwrite("\x00\x00", 2, 1, destfd);
+    corner->v = (uint32_t)((v < 0) ? s->n_positions + v : v - 1);
+    corner->vn = (vn == 0) ? -1 : (int32_t)((vn < 0) ? s->n_normals + vn : vn - 1);
+    return true;
+}
 
-        // Shader type (2b)
-        fwrite(&sm.shadertype, 1, sizeof(uint16_t), destfd);
+// Reads an OBJ file line by line, objects/groups and materials are not kept
+int spillobj(char* filename, stream_spill* s) {
+    FILE* obj = fopen(filename, "r");
+    if (obj == NULL) return 1;
 
-        // Cullmin (3x4b)
-        fwrite(sm.cullmin, 3, sizeof(float), destfd);
+    char* line = malloc(1 << 16);
+    int err = 0;
+    while (!err && fgets(line, 1 << 16, obj) != NULL) {
+        size_t len = strlen(line);
+        if (len == (1 << 16) - 1 && line[len - 1] != '\n') {
+            printf("Error, line too long\n");
+            err = 3;
+        } else if (!strncmp(line, "v ", 2)) {
+            stream_position p = { 0 };
+            float rgb[3];
+            int n = sscanf(line + 2, "%f %f %f %f %f %f", &p.pos[0], &p.pos[1], &p.pos[2], &rgb[0], &rgb[1], &rgb[2]);
+            if (n < 3) err = 2;
+            // Vertex colors (a common extension) are 0-1 floats after the position
+            for (int i = 0; n == 6 && i < 3; ++i) p.col[i] = (uint8_t)(min(max(rgb[i], 0.0f), 1.0f) * 255.0f);
+            fwrite(&p, sizeof(p), 1, s->positions);
+            s->n_positions++;
+        } else if (!strncmp(line, "vn ", 3)) {
+            float n[3];
+            if (sscanf(line + 3, "%f %f %f", &n[0], &n[1], &n[2]) != 3) err = 2;
+            fwrite(n, sizeof(n), 1, s->normals);
+            s->n_normals++;
+        } else if (!strncmp(line, "f ", 2)) {
+            stream_corner polygon[STREAM_MAX_POLYGON];
+            int n = 0;
+            for (char* token = strtok(line + 2, " \t\r\n"); token != NULL && !err; token = strtok(NULL, " \t\r\n")) {
+                if (n == STREAM_MAX_POLYGON) {
+                    printf("Error, faces with more than %d vertices are not supported\n", STREAM_MAX_POLYGON);
+                    err = 3;
+                } else if (!parse_obj_corner(token, s, &polygon[n++])) {
+                    err = 2;
+                }
+            }
+            if (!err) spill_polygon(s, polygon, n);
+        }
+    }
 
-        // Cullmax (3x4b)
-        fwrite(sm.cullmax, 3, sizeof(float), destfd);
+    free(line);
+    fclose(obj);
+    return err;
+}
 
-        // Unknown (2b)
-        fwrite("\x00\x00", 2, 1, destfd);
+typedef struct stream_slot {
+    uint64_t key; // Corner (position and normal index) a part vertex was made from, UINT64_MAX if empty
+    int local;
+} stream_slot;
+
+// Direct-mapped cache of fixed-size records read from a spill file, `n_pages` pages of STREAM_PAGE_SIZE bytes
+typedef struct stream_cache {
+    FILE* file;
+    size_t record; // Record size in bytes
+    int page_records;
+    int n_pages;
+    int64_t* tags; // File page held by each cache page, -1 if none
+    char* data;
+} stream_cache;
+
+void cache_init(stream_cache* c, FILE* file, size_t record, size_t budget) {
+    c->file = file;
+    c->record = record;
+    c->page_records = STREAM_PAGE_SIZE / record;
+    c->n_pages = (int)max(budget / STREAM_PAGE_SIZE, 1);
+    c->tags = malloc(c->n_pages * sizeof(int64_t));
+    memset(c->tags, 0xFF, c->n_pages * sizeof(int64_t));
+    c->data = malloc((size_t)c->n_pages * STREAM_PAGE_SIZE);
+}
 
-        uint16_t len = strlen(sm.id);
-        // Submesh ID (2b+data)
-        fwrite(&len, 1, sizeof(uint16_t), destfd);
-        fprintf(destfd, "%s", sm.id);
+void cache_free(stream_cache* c) {
+    free(c->tags);
+    free(c->data);
+}
 
-        // 3 unknown floats (3x4b)
-        fwrite("\x00\x00\x80\x3F\x00\x00\x80\x3F\x00\x00\x80\x3F", 3, 4, destfd);
+// Returns record #`index`, valid until the next call
+void* cache_get(stream_cache* c, uint32_t index) {
+    int64_t page = index / c->page_records;
+    int slot = (int)(page % c->n_pages);
+    char* data = &c->data[(size_t)slot * STREAM_PAGE_SIZE];
+    if (c->tags[slot] != page) {
+        // Records past the end of the file are never asked for, the last page may be partial
+        _fseeki64(c->file, page * c->page_records * (int64_t)c->record, SEEK_SET);
+        fread(data, c->record, c->page_records, c->file);
+        c->tags[slot] = page;
     }
+    return &data[(index % c->page_records) * c->record];
+}
 
-    fwrite("\x00\x00 created with StormworksMeshExporter v" VERSION_STR, 2, 1, destfd);
+typedef struct stream_part {
+    char* input_filename;
+    char* base; // Output name without extension, parts are <base>_<n>.mesh
+    conversion* c; // Operations applied to every part
+    int index;
+    int max_triangles;
+    mesh m;
+    stream_slot* table;
+} stream_part;
+
+void part_begin(stream_part* p) {
+    p->m = (mesh){ 0 };
+    p->m.vertices = malloc(STREAM_PART_VERTICES * sizeof(vertex));
+    p->m.triangles = malloc(p->max_triangles * sizeof(triangle));
+    memset(p->table, 0xFF, STREAM_TABLE_SIZE * sizeof(stream_slot));
+}
 
-    fflush(destfd);
+// Processes and writes the current part, then starts the next one
+int part_flush(stream_part* p) {
+    if (p->m.n_triangles == 0) return 0;
+
+    char* name = basename(p->input_filename);
+    p->m.n_submeshes = 1;
+    p->m.submeshes = calloc(1, sizeof(submesh));
+    p->m.submeshes[0].id = malloc(strlen(name) + 1);
+    strcpy(p->m.submeshes[0].id, name);
+    p->m.submeshes[0].vertex_count = p->m.n_triangles * 3;
+    recalculate_submesh_bounds(&p->m);
+
+    conversion part = *p->c;
+    part.m = p->m;
+    char* partname = malloc(strlen(p->base) + 32);
+    sprintf(partname, "%s_%d%s", p->base, p->index, OUT_EXTS[OUTPUT_STORMWORKS]);
+
+    // Parts don't go through importfile, so missing normals are fixed here
+    int err = fixnormals(&part.m, p->input_filename);
+    if (!err) err = processfile(&part);
+    if (!err) err = exportfile(p->input_filename, partname, part.m, OUTPUT_STORMWORKS, false);
+    if (!err) printf("Wrote part \"%s\" with %d vertices and %d faces\n", partname, part.m.n_vertices, part.m.n_triangles);
+
+    freemesh(&part.m);
+    free(partname);
+    p->index++;
+    part_begin(p);
+    return err;
+}
 
-    return 0;
+// Returns the part vertex made from `corner` (adding it if `add`), or -1
+int part_vertex(stream_part* p, stream_corner corner, bool add, stream_cache* positions, stream_cache* normals) {
+    uint64_t key = ((uint64_t)corner.v << 32) | (uint32_t)corner.vn;
+    uint32_t slot = (uint32_t)mixhash(key) & (STREAM_TABLE_SIZE - 1);
+    while (p->table[slot].key != UINT64_MAX && p->table[slot].key != key) slot = (slot + 1) & (STREAM_TABLE_SIZE - 1);
+    if (p->table[slot].key == key) return p->table[slot].local;
+    if (!add) return -1;
+
+    int local = p->m.n_vertices++;
+    vertex* vtx = &p->m.vertices[local];
+    stream_position* position = cache_get(positions, corner.v);
+    memcpy(vtx->pos, position->pos, sizeof(vtx->pos));
+    memcpy(vtx->col, position->col, sizeof(vtx->col));
+    if (corner.vn >= 0) {
+        memcpy(vtx->norm, cache_get(normals, corner.vn), sizeof(vtx->norm));
+    } else {
+        memset(vtx->norm, 0, sizeof(vtx->norm)); // Generated when the part is processed
+    }
+    p->table[slot] = (stream_slot){ .key = key, .local = local };
+    return local;
 }
 
-// Step 1: Import a mesh
-int importfile(char* input_filename, int input_mode, mesh* m) {
+// Converts `c` (a PLY or OBJ input) in streaming mode, using about `cap_mb` megabytes of memory
+int streamconvert(conversion* c, int cap_mb) {
     int err = 0;
-    switch (input_mode) {
-        case INPUT_MESH:
-            *m = readmesh(input_filename, &err);
-            break;
-        case INPUT_OBJ:
-            *m = readobj(input_filename, &err);
-            break;
-        case INPUT_PLY:
-            *m = readply(input_filename, &err);
-            break;
+    stream_spill s = { 0 };
+    stream_part p = { .input_filename = c->input_filename, .c = c };
+    stream_cache positions = { 0 }, normals = { 0 };
+
+    // Step 0: Temporary files and part budget
+    char* output = (c->n_output_filenames > 0) ? c->output_filenames[0] : c->input_filename;
+    p.base = malloc(strlen(output) + 1);
+    strcpy(p.base, output);
+    char* ext = strrchr(p.base, '.');
+    if (ext != NULL && strpbrk(ext, "/\\") == NULL) *ext = '\0';
+
+    char* tmpnames[3];
+    const char* tmpexts[3] = { ".positions.tmp", ".normals.tmp", ".corners.tmp" };
+    for (int i = 0; i < 3; ++i) {
+        tmpnames[i] = malloc(strlen(p.base) + strlen(tmpexts[i]) + 1);
+        sprintf(tmpnames[i], "%s%s", p.base, tmpexts[i]);
+    }
+
+    size_t fixed = STREAM_PART_VERTICES * sizeof(vertex) + STREAM_TABLE_SIZE * sizeof(stream_slot) + STREAM_CHUNK_CORNERS * sizeof(stream_corner);
+    size_t cap = (size_t)max(cap_mb, STREAM_MIN_MB) * 1024 * 1024;
+    // The vertex caches get an eighth of the cap each, part triangles get what is left after the fixed buffers
+    size_t cache_budget = cap / 8;
+    p.max_triangles = (int)min((cap - min(fixed, cap / 2) - 2 * cache_budget) / STREAM_TRIANGLE_COST, INT32_MAX / 3);
+
+    s.positions = fopen(tmpnames[0], "w+b");
+    s.normals = fopen(tmpnames[1], "w+b");
+    s.corners = fopen(tmpnames[2], "w+b");
+    if (s.positions == NULL || s.normals == NULL || s.corners == NULL) {
+        printf("Error creating temporary files for \"%s\"\n", c->input_filename);
+        err = 2;
+        goto exit;
     }
 
+    // Step 1: Spill the input
+    err = (c->input_mode == INPUT_PLY) ? spillply(c->input_filename, &s) : spillobj(c->input_filename, &s);
     if (err) {
-        printf("Error %d importing file \"%s\"\n", err, input_filename);
-    } else {
-        printf("Successfully imported \"%s\" with %d vertices and %d faces\n", input_filename, m->n_vertices, m->n_triangles);
+        printf("Error %d reading file \"%s\"\n", err, c->input_filename);
+        goto exit;
+    }
+    printf("Read \"%s\" with %u vertices, %u normals and %llu faces, writing parts of up to %d faces\n",
+        c->input_filename, s.n_positions, s.n_normals, (unsigned long long)s.n_triangles, p.max_triangles);
+
+    fflush(s.positions);
+    fflush(s.normals);
+    fflush(s.corners);
+    rewind(s.corners);
+
+    // Step 2: Read the vertex data through the caches and build parts from the corners
+    cache_init(&positions, s.positions, sizeof(stream_position), cache_budget);
+    cache_init(&normals, s.normals, sizeof(float[3]), cache_budget);
+
+    p.table = malloc(STREAM_TABLE_SIZE * sizeof(stream_slot));
+    part_begin(&p);
+
+    stream_corner* chunk = malloc(STREAM_CHUNK_CORNERS * sizeof(stream_corner));
+    int invalid = 0;
+    size_t n_read;
+    while (!err && (n_read = fread(chunk, sizeof(stream_corner), STREAM_CHUNK_CORNERS, s.corners)) >= 3) {
+        for (size_t k = 0; k + 3 <= n_read && !err; k += 3) {
+            stream_corner* tri = &chunk[k];
+            bool valid = true;
+            for (int i = 0; i < 3; ++i) {
+                valid &= tri[i].v < s.n_positions && (tri[i].vn < 0 || (uint32_t)tri[i].vn < s.n_normals);
+            }
+            if (!valid) {
+                invalid++;
+                continue;
+            }
+
+            // A new part is started if this triangle's new vertices don't fit in the current one
+            int n_new = 0;
+            for (int i = 0; i < 3; ++i) {
+                bool repeated = (i > 0 && !memcmp(&tri[i], &tri[0], sizeof(stream_corner))) || (i > 1 && !memcmp(&tri[i], &tri[1], sizeof(stream_corner)));
+                n_new += !repeated && part_vertex(&p, tri[i], false, &positions, &normals) < 0;
+            }
+            if (p.m.n_vertices + n_new > STREAM_PART_VERTICES || p.m.n_triangles == p.max_triangles) err = part_flush(&p);
+            if (err) break;
 
+            triangle* t = &p.m.triangles[p.m.n_triangles++];
+            for (int i = 0; i < 3; ++i) t->i[i] = part_vertex(&p, tri[i], true, &positions, &normals);
+        }
     }
+    if (!err) err = part_flush(&p);
+    if (invalid) printf("Warning: skipped %d faces referencing missing vertices or normals\n", invalid);
+    if (!err) printf("Successfully converted \"%s\" into %d parts\n", c->input_filename, p.index);
 
+    free(chunk);
+    freemesh(&p.m);
+    free(p.table);
+
+exit:
+    cache_free(&positions);
+    cache_free(&normals);
+    if (s.positions != NULL) fclose(s.positions);
+    if (s.normals != NULL) fclose(s.normals);
+    if (s.corners != NULL) fclose(s.corners);
+    for (int i = 0; i < 3; ++i) {
+        remove(tmpnames[i]);
+        free(tmpnames[i]);
+    }
+    free(p.base);
     return err;
 }
 
-// Step 3: Export the mesh after processing
-int exportfile(char* input_filename, char* output_filename, mesh m, int output_mode, bool cout) {
-    int err = 0;
+int runstream(conversion* conversions, int n_conversions, int cap_mb) {
+    for (int i = 0; i < n_conversions; ++i) {
+        conversion* c = &conversions[i];
+        if (c->input_mode != INPUT_PLY && c->input_mode != INPUT_OBJ) {
+            printf("Error, streaming conversion only supports PLY and OBJ inputs (\"%s\")\n", c->input_filename);
+            return 5;
+        }
+        c->err = streamconvert(c, cap_mb);
+        if (c->err) return c->err;
+    }
+    return 0;
+}
 
-    if (output_filename == NULL) {
-        memcpy(tmp_buf, input_filename, strlen(input_filename));
-        chgfname(tmp_buf, output_mode);
-        output_filename = tmp_buf;
+// Spatial hash grid over vertex positions, for finding vertices within a distance in constant time
+// Vertices are bucketed by grid cell (cell size = search radius) with a counting sort, so the grid is built in linear time
+typedef struct vertex_grid {
+    vertex* vertices;
+    float cellsize;
+    uint32_t mask; // Number of buckets - 1 (power of two)
+    int* bucket_start; // Bucket b holds items[bucket_start[b]..bucket_start[b + 1])
+    int* items;
+} vertex_grid;
+
+int64_t gridcell(float coord, float cellsize) {
+    double c = floor((double)coord / cellsize);
+    return (int64_t)max(min(c, 1e15), -1e15);
+}
+
+uint32_t gridbucket(vertex_grid* g, int64_t x, int64_t y, int64_t z) {
+    return (uint32_t)mixhash((uint64_t)x * 0x9e3779b97f4a7c15ULL ^ (uint64_t)y * 0xc2b2ae3d27d4eb4fULL ^ (uint64_t)z * 0x165667b19e3779f9ULL) & g->mask;
+}
+
+void buildgrid(vertex_grid* g, vertex* vertices, int n_vertices, float cellsize) {
+    g->vertices = vertices;
+    g->cellsize = cellsize;
+
+    uint32_t n_buckets = 1;
+    while (n_buckets < (uint32_t)n_vertices * 2) n_buckets <<= 1;
+    g->mask = n_buckets - 1;
+
+    g->bucket_start = calloc(n_buckets + 1, sizeof(int));
+    g->items = malloc(max(n_vertices, 1) * sizeof(int));
+    uint32_t* buckets = malloc(max(n_vertices, 1) * sizeof(uint32_t));
+
+    for (int v = 0; v < n_vertices; ++v) {
+        buckets[v] = gridbucket(g, gridcell(vertices[v].x, cellsize), gridcell(vertices[v].y, cellsize), gridcell(vertices[v].z, cellsize));
+        g->bucket_start[buckets[v] + 1]++;
     }
+    for (uint32_t b = 0; b < n_buckets; ++b) g->bucket_start[b + 1] += g->bucket_start[b];
 
-    // Print general information about the mesh to be exported
-    printf("Mesh processed with %d vertices and %d faces\n", m.n_vertices, m.n_triangles);
-    for (int i = 0; i < m.n_submeshes; ++i) {
-        printf(
-            "Submesh \"%s\" starting at face %d containing %d faces using shader #%d (%s)\n",
-            m.submeshes[i].id,
-            m.submeshes[i].start_index / 3,
-            m.submeshes[i].vertex_count / 3,
-            m.submeshes[i].shadertype,
-            SHADER_TYPES[m.submeshes[i].shadertype]
-        );
+    int* fill = malloc(n_buckets * sizeof(int));
+    memcpy(fill, g->bucket_start, n_buckets * sizeof(int));
+    for (int v = 0; v < n_vertices; ++v) g->items[fill[buckets[v]]++] = v;
+
+    free(fill);
+    free(buckets);
+}
+
+void freegrid(vertex_grid* g) {
+    free(g->bucket_start);
+    free(g->items);
+}
+
+// Returns the vertex of the grid closest to `pos` within `radius` (which must not exceed the cell size), or -1
+// Among vertices at the same distance, one with the same normal and color as `like` is preferred
+int gridnearest(vertex_grid* g, vertex like, float radius) {
+    int64_t cx = gridcell(like.x, g->cellsize), cy = gridcell(like.y, g->cellsize), cz = gridcell(like.z, g->cellsize);
+    int best = -1;
+    float bestdist = radius * radius;
+    bool bestsame = false;
+
+    for (int dx = -1; dx <= 1; ++dx) {
+        for (int dy = -1; dy <= 1; ++dy) {
+            for (int dz = -1; dz <= 1; ++dz) {
+                uint32_t b = gridbucket(g, cx + dx, cy + dy, cz + dz);
+                for (int k = g->bucket_start[b]; k < g->bucket_start[b + 1]; ++k) {
+                    vertex v = g->vertices[g->items[k]];
+                    float d = (v.x - like.x) * (v.x - like.x) + (v.y - like.y) * (v.y - like.y) + (v.z - like.z) * (v.z - like.z);
+                    bool same = !memcmp(v.col, like.col, 4) && !memcmp(v.norm, like.norm, sizeof(v.norm));
+                    if (d < bestdist || (d == bestdist && (best < 0 || (same && !bestsame)))) {
+                        best = g->items[k];
+                        bestdist = d;
+                        bestsame = same;
+                    }
+                }
+            }
+        }
+    }
+    return best;
+}
+
+typedef struct match_ctx {
+    vertex* vertices;
+    int n_vertices;
+    vertex_grid* grid;
+    float tolerance;
+    int* matches;
+} match_ctx;
+
+#define MATCH_BLOCK 4096
+
+void match_block(void* param, int block) {
+    match_ctx* ctx = param;
+    int end = min((block + 1) * MATCH_BLOCK, ctx->n_vertices);
+    for (int v = block * MATCH_BLOCK; v < end; ++v) {
+        ctx->matches[v] = gridnearest(ctx->grid, ctx->vertices[v], ctx->tolerance);
     }
+}
+
+// For every vertex of `a`, finds the closest vertex of `b` within `tolerance` (-1 if there is none), in parallel
+int* matchvertices(mesh a, mesh b, float tolerance) {
+    vertex_grid grid;
+    buildgrid(&grid, b.vertices, b.n_vertices, max(tolerance, 1e-6f));
 
-    if (output_mode == OUTPUT_MULTI_PLY) {
-        char* outdir = malloc(128);
-        memcpy(outdir, output_filename, strlen(output_filename) + 1);
-        outdir[strlen(outdir) - 4] = '\0';
+    match_ctx ctx = { .vertices = a.vertices, .n_vertices = a.n_vertices, .grid = &grid, .tolerance = tolerance };
+    ctx.matches = malloc(max(a.n_vertices, 1) * sizeof(int));
+    parallel_for((a.n_vertices + MATCH_BLOCK - 1) / MATCH_BLOCK, match_block, &ctx);
+
+    freegrid(&grid);
+    return ctx.matches;
+}
 
-        CreateDirectory(outdir, NULL);
+// Prints the differences between submesh `sa` of `a` and `sb` of `b`, returns true if there are any
+bool diffsubmesh(mesh a, int sa, mesh b, int sb, float tolerance) {
+    submesh sma = a.submeshes[sa], smb = b.submeshes[sb];
+    bool differs = false;
 
-        char* buf = malloc(128);
+    // Standalone copies only contain the vertices each submesh references
+    mesh ca, cb;
+    extract_submesh(a, sa, &ca);
+    extract_submesh(b, sb, &cb);
 
-        for (int s = 0; s < m.n_submeshes; ++s) {
-            submesh sm = m.submeshes[s];
-            strcpy(buf, outdir);
-            snprintf(buf, 128, "%s/%s-%s.ply", outdir, sm.id, SHADER_TYPES[sm.shadertype]);
+    printf("Submesh \"%s\" (#%d) vs \"%s\" (#%d):\n", sma.id, sa, smb.id, sb);
 
-            mesh sub;
+    if (sma.shadertype != smb.shadertype) {
+        printf("\tshader: %d vs %d\n", sma.shadertype, smb.shadertype);
+        differs = true;
+    }
+    if (ca.n_triangles != cb.n_triangles) {
+        printf("\tfaces: %d vs %d\n", ca.n_triangles, cb.n_triangles);
+        differs = true;
+    }
+    if (ca.n_vertices != cb.n_vertices) {
+        printf("\tvertices: %d vs %d\n", ca.n_vertices, cb.n_vertices);
+        differs = true;
+    }
 
-            sub.vertices = m.vertices;
-            sub.n_vertices = m.n_vertices;
+    float bounds = 0;
+    for (int i = 0; i < 3; ++i) {
+        bounds = max(bounds, fabsf(sma.cullmin[i] - smb.cullmin[i]));
+        bounds = max(bounds, fabsf(sma.cullmax[i] - smb.cullmax[i]));
+    }
+    if (bounds > tolerance) {
+        printf("\tbounds differ by up to %f\n", bounds);
+        differs = true;
+    }
 
-            sub.triangles = &m.triangles[sm.start_index / 3];
-            sub.n_triangles = sm.vertex_count / 3;
+    int* atob = matchvertices(ca, cb, tolerance);
+    int* btoa = matchvertices(cb, ca, tolerance);
 
-            FILE* outfile = fopen(buf, "w");
-            err = writeply(sub, outfile);
-            if (err) {
-                free(buf);
-                free(outdir);
-                goto exit;
-            }
-            fclose(outfile);
+    int unmatched_a = 0, unmatched_b = 0, normals = 0, colors = 0, maxcolor = 0;
+    float maxnormal = 0;
+    for (int v = 0; v < ca.n_vertices; ++v) {
+        if (atob[v] < 0) {
+            unmatched_a++;
+            continue;
         }
 
-        free(buf);
-        free(outdir);
-    } else if (output_mode == OUTPUT_NONE) {
-        // Do nothing!
-    } else {
-        FILE* outfile;
-        if (cout) {
-            outfile = stdout;
-        } else {
-            outfile = fopen(output_filename, output_mode == OUTPUT_STORMWORKS ? "wb" : "w");
-            if (outfile == NULL) {
-                err = 2;
-                goto exit;
-            }
+        vertex va = ca.vertices[v], vb = cb.vertices[atob[v]];
+        float nd = max(max(fabsf(va.nx - vb.nx), fabsf(va.ny - vb.ny)), fabsf(va.nz - vb.nz));
+        if (nd > tolerance) {
+            normals++;
+            maxnormal = max(maxnormal, nd);
         }
 
-        switch (output_mode) {
-            case OUTPUT_PLY:
-                err = writeply(m, outfile);
-                break;
-            case OUTPUT_OBJ:
-                err = writeobj(m, outfile);
-                break;
-            case OUTPUT_STORMWORKS:
-                err = writemesh(m, outfile);
-                break;
-            case OUTPUT_TEXT:
-                err = writedebug(m, outfile);
-                break;
-            default:
-                break;
+        int cd = 0;
+        for (int i = 0; i < 4; ++i) cd = max(cd, abs(va.col[i] - vb.col[i]));
+        if (cd > 0) {
+            colors++;
+            maxcolor = max(maxcolor, cd);
         }
+    }
+    for (int v = 0; v < cb.n_vertices; ++v) unmatched_b += btoa[v] < 0;
 
-        fflush(outfile);
-        fclose(outfile);
+    if (unmatched_a || unmatched_b) {
+        printf("\tpositions: %d of %d vertices have no match within tolerance, %d of %d the other way\n",
+            unmatched_a, ca.n_vertices, unmatched_b, cb.n_vertices);
+        differs = true;
+    }
+    if (normals) {
+        printf("\tnormals: %d matched vertices differ (by up to %f)\n", normals, maxnormal);
+        differs = true;
+    }
+    if (colors) {
+        printf("\tcolors: %d matched vertices differ (by up to %d)\n", colors, maxcolor);
+        differs = true;
     }
 
-exit:
-    if (err) printf("Error #%d exporting mesh %s\n", err, output_filename);
-    // freemesh(&m);
-    return err;
-}
+    // Faces of `a` are looked up in `b` through the vertex matches
+    uint64_t* keys = malloc(max(cb.n_triangles, 1) * sizeof(uint64_t));
+    for (int t = 0; t < cb.n_triangles; ++t) keys[t] = trianglekey(cb.triangles[t].a, cb.triangles[t].b, cb.triangles[t].c);
+    qsort(keys, cb.n_triangles, sizeof(uint64_t), cmp_u64);
 
-int swapaxes(mesh* m, char* argument) {
-    if (strlen(argument) != 2) {
-        printf("Error swapping axes: exactly 2 axes must be provided\n");
-        return 1;
+    int missing = 0;
+    for (int t = 0; t < ca.n_triangles; ++t) {
+        int ia = atob[ca.triangles[t].a], ib = atob[ca.triangles[t].b], ic = atob[ca.triangles[t].c];
+        uint64_t key = trianglekey(ia, ib, ic);
+        if (ia < 0 || ib < 0 || ic < 0 || bsearch(&key, keys, cb.n_triangles, sizeof(uint64_t), cmp_u64) == NULL) missing++;
+    }
+    if (missing) {
+        printf("\tfaces: %d of %d have no matching face\n", missing, ca.n_triangles);
+        differs = true;
     }
 
-    int axis1 = argument[0] - 'X';
-    int axis2 = argument[1] - 'X';
+    if (!differs) printf("\tidentical within tolerance\n");
 
-    if (((axis1 < 0) || (axis1 > 2)) || ((axis2 < 0) || (axis2 > 2))) {
-        printf("Error swapping axes: invalid axes to swap \'%c\' and \'%c\'", argument[0], argument[1]);
-        return 2;
+    free(keys);
+    free(atob);
+    free(btoa);
+    freemesh(&ca);
+    freemesh(&cb);
+    return differs;
+}
+
+// Prints the geometric differences between meshes `a` and `b`, submeshes are paired by ID (or by index if the
+// ID is not present in the other mesh). Returns true if the meshes are not equivalent within `tolerance`.
+bool diffmeshes(char* name_a, mesh a, char* name_b, mesh b, float tolerance) {
+    bool differs = false;
+    bool* paired_b = calloc(max(b.n_submeshes, 1), sizeof(bool));
+
+    printf("--BEGIN MESH DIFF--\n");
+    printf("\"%s\" (%d submeshes) vs \"%s\" (%d submeshes), tolerance %f\n", name_a, a.n_submeshes, name_b, b.n_submeshes, tolerance);
+
+    for (int sa = 0; sa < a.n_submeshes; ++sa) {
+        int sb = -1;
+        for (int k = 0; k < b.n_submeshes && sb < 0; ++k) {
+            if (!paired_b[k] && !strcmp(a.submeshes[sa].id, b.submeshes[k].id)) sb = k;
+        }
+        if (sb < 0 && sa < b.n_submeshes && !paired_b[sa]) {
+            bool idused = false;
+            for (int k = 0; k < a.n_submeshes; ++k) idused |= !strcmp(a.submeshes[k].id, b.submeshes[sa].id);
+            if (!idused) sb = sa;
+        }
+
+        if (sb < 0) {
+            printf("Submesh \"%s\" (#%d) is only in \"%s\"\n", a.submeshes[sa].id, sa, name_a);
+            differs = true;
+            continue;
+        }
+
+        paired_b[sb] = true;
+        differs |= diffsubmesh(a, sa, b, sb, tolerance);
+    }
+
+    for (int sb = 0; sb < b.n_submeshes; ++sb) {
+        if (!paired_b[sb]) {
+            printf("Submesh \"%s\" (#%d) is only in \"%s\"\n", b.submeshes[sb].id, sb, name_b);
+            differs = true;
+        }
     }
 
-    float tmp = 0;
-    for (int i = 0; i < m->n_vertices; ++i) {
-        tmp = m->vertices[i].pos[axis1];
-        m->vertices[i].pos[axis1] = m->vertices[i].pos[axis2];
-        m->vertices[i].pos[axis2] = tmp;
+    printf("--END MESH DIFF--\n");
+    printf("\"%s\" and \"%s\" are %s\n", name_a, name_b, differs ? "different" : "equivalent");
 
-        tmp = m->vertices[i].norm[axis1];
-        m->vertices[i].norm[axis1] = m->vertices[i].norm[axis2];
-        m->vertices[i].norm[axis2] = tmp;
+    free(paired_b);
+    return differs;
+}
+
+// Imports and processes the conversions in pairs and compares each pair instead of exporting
+// Returns 9 if any pair differs
+int rundiff(conversion* conversions, int n_conversions, float tolerance) {
+    if (n_conversions % 2) {
+        printf("Error, meshes to compare must be given in pairs\n");
+        return 5;
     }
 
-    printf("Successfully swapped %c and %c axes.\n", axis1 + 'X', axis2 + 'X');
+    bool differs = false;
+    for (int i = 0; i < n_conversions; i += 2) {
+        conversion* a = &conversions[i];
+        conversion* b = &conversions[i + 1];
 
-    return 0;
+        a->err = importfile(a->input_filename, a->input_mode, a->hasselection ? &a->selection : NULL, &a->m);
+        if (!a->err) a->err = processfile(a);
+        b->err = importfile(b->input_filename, b->input_mode, b->hasselection ? &b->selection : NULL, &b->m);
+        if (!b->err) b->err = processfile(b);
+
+        int err = a->err ? a->err : b->err;
+        if (!err) differs |= diffmeshes(a->input_filename, a->m, b->input_filename, b->m, tolerance);
+
+        freemesh(&a->m);
+        freemesh(&b->m);
+        if (err) return err;
+    }
+
+    return differs ? 9 : 0;
 }
 
 int main(int argc, char** argv) {
     int res = 0;
 
-    int output_mode = OUTPUT_PLY, input_mode = INPUT_MESH;
-    bool consoleout = false;
-
-    char* input_filename = NULL;
-
-    bool hasmesh = false;
-    mesh m;
+    int output_modes[MAX_OUTPUTS] = { OUTPUT_PLY }, n_output_modes = 1, input_mode = INPUT_MESH;
+    char* output_names[MAX_OUTPUTS];
+    bool consoleout = false, showhelp = false;
+    bool pipelined = false;
+    bool diff = false;
+    int stream_mb = 0;
+    float tolerance = 1e-4f;
+
+    char* dedupe_dir = NULL;
+    bool dedupe_link = false;
+    char* pack_dir = NULL;
+    char* list_pack = NULL;
+    char* watch_dir = NULL;
+    bool hasoutputmode = false;
+
+    bool hasselection = false;
+    submesh_selector selection = { .index = -1 };
+
+    // The command line is collected into a list of conversions first, then they are all run
+    conversion* conversions = NULL;
+    int n_conversions = 0;
+    conversion* current = NULL; // Conversion still accepting operations and an output name
 
     // v0.2: More inputs (and way more other random things)
     // DONE: Manual output file selection
@@ -949,6 +4602,7 @@ int main(int argc, char** argv) {
     // DONE: Document all options, limitations, & capabilities after proper CLI is done in HELPSTR
     // DONE: OBJ export submeshes and shader types in object names
     // NOTE: Refactored for a more "pipelined" import->process->export flow to allow more mesh operations in the future.
+    // NOTE: The command line is now collected into conversions before running, so the stages can overlap (-p)
     // TODO: Stormworks physics mesh IO
     // TODO: Warning/error when exporting .mesh with too many vertices, too large of parameters, etc.
 
@@ -958,29 +4612,55 @@ int main(int argc, char** argv) {
     // TODO: Directory mode: Searches input directory for all files matching input type and converts them to selected output type. if an output option is provided, use it as a directory to store the output files. recursive option
     // TODO: Allow MISO (multiple-input-single-output) mesh converting with -i input file flags and specification of submesh data for each input (shader type, etc.)
     // TODO: ^ Multi-PLY folder input 
-    // TODO: ^ add 'operations' more flags! (merge, select submesh [by ID or name], swap axes, set shader, offset?)
+    // TODO: ^ add 'operations' more flags! (merge, swap axes, set shader, offset?)
+    // DONE: Select submesh [by index or ID] (random-access for .mesh input)
+
+    static struct option long_options[] = {
+        { "help", no_argument, NULL, 'h' },
+        { "dedupe", required_argument, NULL, 'D' },
+        { "dedupe-link", required_argument, NULL, 'L' },
+        { "pack", required_argument, NULL, 'K' },
+        { "list", required_argument, NULL, 'l' },
+        { "watch", required_argument, NULL, 'W' },
+        { "diff", no_argument, NULL, 'd' },
+        { "normals", required_argument, NULL, 'N' },
+        { "clean", no_argument, NULL, 'c' },
+        { "stream", required_argument, NULL, 'Z' },
+        { "tolerance", required_argument, NULL, 't' },
+        { 0, 0, 0, 0 }
+    };
 
     int opt;
-    while ((opt = getopt(argc, argv, "-:I:O:S:o:A:hC")) != -1) {
+    while (!showhelp && (opt = getopt_long(argc, argv, "-:I:O:S:s:o:A:N:D:L:K:l:W:t:Z:hCpdc", long_options, NULL)) != -1) {
         switch (opt) {
-            case 'O':
-                if (!strcasecmp(optarg, "obj")) {
-                    output_mode = OUTPUT_OBJ;
-                } else if (!strcasecmp(optarg, "ply")) {
-                    output_mode = OUTPUT_PLY;
-                } else if (!strcasecmp(optarg, "mesh") || !strcasecmp(optarg, "stormworks")) {
-                    output_mode = OUTPUT_STORMWORKS;
-                } else if (!strcasecmp(optarg, "plys") || !strcasecmp(optarg, "multiply")) {
-                    output_mode = OUTPUT_MULTI_PLY;
-                } else if (!strcasecmp(optarg, "text")) {
-                    output_mode = OUTPUT_TEXT;
-                } else if (!strcasecmp(optarg, "dryrun")) {
-                    output_mode = OUTPUT_NONE;
-                } else {
-                    printf("Error, invalid output type \"%s\", see help (-h) for valid options.\n", optarg);
+            case 'O': // Output mode(s), comma-separated
+                n_output_modes = splitlist(optarg, output_names, MAX_OUTPUTS);
+                if (n_output_modes < 0) {
+                    printf("Error, at most %d output types can be given to -O\n", MAX_OUTPUTS);
                     res = 5;
                     goto exit;
                 }
+                for (int i = 0; i < n_output_modes; ++i) {
+                    output_modes[i] = parse_output_mode(output_names[i]);
+                    if (output_modes[i] < 0) {
+                        printf("Error, invalid output type \"%s\", see help (-h) for valid options.\n", output_names[i]);
+                        res = 5;
+                        goto exit;
+                    }
+                    for (int j = 0; j < i; ++j) {
+                        if (output_modes[j] == output_modes[i]) {
+                            printf("Error, output type \"%s\" is given more than once\n", output_names[i]);
+                            res = 5;
+                            goto exit;
+                        }
+                    }
+                }
+                if (n_output_modes == 0) {
+                    printf("Error, output type must be specified after -O\n");
+                    res = 7;
+                    goto exit;
+                }
+                hasoutputmode = true;
                 break;
             case 'I':
                 if (!strcasecmp(optarg, "obj")) {
@@ -989,6 +4669,10 @@ int main(int argc, char** argv) {
                     input_mode = INPUT_MESH;
                 } else if (!strcasecmp(optarg, "ply")) {
                     input_mode = INPUT_PLY;
+                } else if (!strcasecmp(optarg, "pack") || !strcasecmp(optarg, "swpack")) {
+                    input_mode = INPUT_PACK;
+                } else if (!strcasecmp(optarg, "text") || !strcasecmp(optarg, "txt")) {
+                    input_mode = INPUT_TEXT;
                 } else {
                     printf("Error, invalid input type \"%s\", see help (-h) for valid options.\n", optarg);
                     res = 5;
@@ -1002,51 +4686,116 @@ int main(int argc, char** argv) {
             case 'S': // Submesh shader override
                 break;
 
+            case 's': // Submesh selection (applies to the next input only)
+                selection = parse_selector(optarg);
+                hasselection = true;
+                break;
+
+            case 'D': // Library duplicate scan
+            case 'L': // Library duplicate scan, converting unique meshes and linking duplicates
+                dedupe_dir = optarg;
+                dedupe_link = opt == 'L';
+                break;
+
+            case 'K': // Pack a directory
+                pack_dir = optarg;
+                break;
+
+            case 'l': // List the entries of a pack
+                list_pack = optarg;
+                break;
+
+            case 'W': // Watch a directory
+                watch_dir = optarg;
+                break;
+
+            case 'd': // Compare inputs in pairs instead of converting
+                diff = true;
+                break;
+
+            case 't': { // Diff tolerance
+                char* end;
+                tolerance = strtod(optarg, &end);
+                if (end == optarg || *end != '\0' || !isfinite(tolerance) || tolerance < 0) {
+                    printf("Error, invalid tolerance \"%s\", it must be a number >= 0\n", optarg);
+                    res = 5;
+                    goto exit;
+                }
+                break;
+            }
+
+            case 'Z': // Streaming conversion with a memory cap
+                stream_mb = atoi(optarg);
+                if (stream_mb < STREAM_MIN_MB) {
+                    printf("WARNING: Streaming memory cap raised to the minimum of %d MB.\n", STREAM_MIN_MB);
+                    stream_mb = STREAM_MIN_MB;
+                }
+                break;
+
+            case 'p': // Pipelined execution
+                pipelined = true;
+                break;
+
             case 'A': // Swap axes
-                if (!hasmesh) {
-                    printf("WARNING: Mesh not present to swap axes, skipping.\n");
+            case 'N': // Generate normals
+            case 'c': // Clean up geometry
+                if (opt == 'N') {
+                    char* end;
+                    double angle = strtod(optarg, &end);
+                    if (end == optarg || *end != '\0' || !isfinite(angle) || angle < 0 || angle > 180) {
+                        printf("Error, invalid smoothing angle \"%s\", it must be a number from 0 to 180\n", optarg);
+                        res = 5;
+                        goto exit;
+                    }
+                }
+                if (current == NULL) {
+                    printf("WARNING: Mesh not present to %s, skipping.\n", (opt == 'A') ? "swap axes" : (opt == 'N') ? "generate normals" : "clean up");
+                } else if (current->n_operations == MAX_OPERATIONS) {
+                    printf("WARNING: Too many operations on \"%s\", skipping.\n", current->input_filename);
                 } else {
-                    res = swapaxes(&m, optarg);
-                    if (res) goto exit;
+                    current->operations[current->n_operations++] = (operation){ .opt = opt, .arg = optarg };
                 }
                 break;
 
             case 1:
-                // If there is a file that hasn't been converted yet and no output has been given, convert it automatically.
-                // if (inpfile != NULL) {
-                //     processfile(inpfile, NULL, input_mode, output_mode, consoleout);
-                //     inpfile = NULL;
-                // }
-                // inpfile = optarg;
-
-                if (hasmesh) {
-                    res = exportfile(input_filename, NULL, m, output_mode, consoleout);
-                    if (res) goto exit;
-                    freemesh(&m);
-                    hasmesh = false;
-                    input_filename = NULL;
+                // If there is a file that hasn't been converted yet and no output has been given, it will be converted automatically.
+                if (current != NULL) {
+                    memcpy(current->output_modes, output_modes, sizeof(output_modes));
+                    current->n_output_modes = n_output_modes;
+                    current->cout = consoleout;
                 }
-                input_filename = optarg;
-                res = importfile(input_filename, input_mode, &m);
-                hasmesh = true;
-                if (res)
-                    goto exit;
 
+                conversions = realloc(conversions, (n_conversions + 1) * sizeof(conversion));
+                current = &conversions[n_conversions++];
+                *current = (conversion){
+                    .input_filename = optarg,
+                    .input_mode = input_mode,
+                    .hasselection = hasselection,
+                    .selection = selection
+                };
+                hasselection = false;
                 break;
 
-            case 'o': // When output name is given, convert the previous file
-                // processfile(inpfile, optarg, input_mode, output_mode, consoleout);
-                // inpfile = NULL;
-                res = exportfile(input_filename, optarg, m, output_mode, consoleout);
-                if (res) goto exit;
-                freemesh(&m);
-                hasmesh = false;
-                input_filename = NULL;
+            case 'o': // When output name is given, the previous file is complete
+                if (current == NULL) {
+                    printf("WARNING: No input file for output \"%s\", skipping.\n", optarg);
+                    break;
+                }
+                current->n_output_filenames = splitlist(optarg, current->output_filenames, MAX_OUTPUTS);
+                if (current->n_output_filenames < 0) {
+                    printf("Error, at most %d output files can be given to -o\n", MAX_OUTPUTS);
+                    res = 5;
+                    goto exit;
+                }
+                memcpy(current->output_modes, output_modes, sizeof(output_modes));
+                current->n_output_modes = n_output_modes;
+                current->cout = consoleout;
+                current = NULL;
                 break;
 
-            case 'h':
+            case 'h': // Files given before -h are still converted, nothing after it is read
                 printf("%s", HELPSTR);
-                goto exit;
+                showhelp = true;
                 break;
             case '?': // Unknown arg
                 printf("Error, unknown argument \'%c\'\n", optopt);
@@ -1065,22 +4814,77 @@ int main(int argc, char** argv) {
         }
     }
 
-    // Process the last filename
-    // if (inpfile != NULL)
-    //     processfile(inpfile, NULL, input_mode, output_mode, consoleout);
+    // The last file uses the output modes given last
+    if (current != NULL) {
+        memcpy(current->output_modes, output_modes, sizeof(output_modes));
+        current->n_output_modes = n_output_modes;
+        current->cout = consoleout;
+        current = NULL;
+    }
 
-    if (hasmesh) {
-        res = exportfile(input_filename, NULL, m, output_mode, consoleout);
-        if (res) goto exit;
-        freemesh(&m);
-        hasmesh = false;
-        input_filename = NULL;
+    // Outputs of a conversion are written concurrently, so none of them may share a path
+    for (int i = 0; i < n_conversions; ++i) {
+        if (!conversions[i].cout && duplicate_outputs(&conversions[i])) {
+            res = 5;
+            goto exit;
+        }
     }
 
+    // Keep STDOUT clean for the mesh output: the real STDOUT is kept for it and everything else goes to STDERR
+    cout_stream = stdout;
+    if (consoleout) {
+        fflush(stdout);
+        cout_stream = fdopen(dup(fileno(stdout)), "wb");
+        dup2(fileno(stderr), fileno(stdout));
+    }
 
-exit:
-    if (hasmesh) {
-        freemesh(&m);
+    // Streaming only writes .mesh parts, named after the first output without its extension
+    if (stream_mb > 0) {
+        for (int i = 0; i < n_output_modes && hasoutputmode; ++i) {
+            if (output_modes[i] != OUTPUT_STORMWORKS) printf("WARNING: Streaming conversion only writes MESH parts, output type \"%s\" is ignored.\n", output_names[i]);
+        }
+        for (int i = 0; i < n_conversions; ++i) {
+            for (int o = 0; o < conversions[i].n_output_filenames; ++o) {
+                char* name = conversions[i].output_filenames[o];
+                if (o > 0) {
+                    printf("WARNING: Streaming conversion only uses the first output name, \"%s\" is ignored.\n", name);
+                } else if (!hasext(name, OUT_EXTS[OUTPUT_STORMWORKS])) {
+                    printf("WARNING: Streaming conversion writes \"%s\" as MESH parts (<name>_0.mesh, <name>_1.mesh, ...).\n", name);
+                }
+            }
+        }
+    }
+
+    if (diff) {
+        res = rundiff(conversions, n_conversions, tolerance);
+    } else if (stream_mb > 0) {
+        res = runstream(conversions, n_conversions, stream_mb);
+    } else if (pipelined) {
+        res = runpipeline(conversions, n_conversions);
+    } else {
+        res = runsequential(conversions, n_conversions);
+    }
+    if (showhelp) goto exit;
+
+    if (!res && dedupe_dir != NULL) {
+        res = dedupelibrary(dedupe_dir, input_mode, dedupe_link, output_modes, n_output_modes);
     }
+
+    if (!res && pack_dir != NULL) {
+        res = packdirectory(pack_dir, input_mode);
+    }
+
+    if (!res && list_pack != NULL) {
+        res = listpack(list_pack);
+    }
+
+    if (!res && watch_dir != NULL) {
+        // Watched files are converted to Stormworks meshes unless told otherwise
+        if (!hasoutputmode) output_modes[0] = OUTPUT_STORMWORKS;
+        res = watchdirectory(watch_dir, input_mode, output_modes, n_output_modes);
+    }
+
+exit:
+    free(conversions);
     return res;
 }
\ No newline at end of file